@@ -2,10 +2,22 @@
 #define TINYLANG_AST_AST_H
 
 #include "tinylang/Basic/LLVM.h"
+#include "tinylang/Basic/SourceOffset.h"
 #include "tinylang/Basic/TokenKinds.h"
 #include "llvm/ADT/APSInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/iterator.h"
+#include "llvm/ADT/iterator_range.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/SMLoc.h"
+#include "llvm/Support/TrailingObjects.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -22,25 +34,99 @@ using DeclList = std::vector<Decl *>;
 using FormalParamList =
     std::vector<FormalParameterDeclaration *>;
 using ExprList = std::vector<Expr *>;
-using SelectorList = std::vector<Selector *>;
 using StmtList = std::vector<Stmt *>;
 using IdentList = std::vector<std::pair<SMLoc, StringRef>>;
 
+/// A name, interned by the ASTContext. It is one pointer
+/// wide, and equal names have equal identifiers.
+class Identifier {
+  const llvm::StringMapEntry<char> *Entry = nullptr;
+
+public:
+  Identifier() = default;
+  explicit Identifier(
+      const llvm::StringMapEntry<char> *Entry)
+      : Entry(Entry) {}
+
+  StringRef getName() const {
+    return Entry ? Entry->getKey() : StringRef();
+  }
+
+  bool operator==(Identifier Other) const {
+    return Entry == Other.Entry;
+  }
+  bool operator!=(Identifier Other) const {
+    return Entry != Other.Entry;
+  }
+};
+
+/// Finds the members of a declaration by name. Short lists
+/// are searched linearly; for longer ones, the position of
+/// each name is hashed on the first lookup, which may
+/// happen on several threads at once.
+class NameIndex {
+  std::atomic<bool> Built{false};
+  std::mutex Mutex;
+  llvm::StringMap<unsigned> Positions;
+
+public:
+  /// Lists shorter than this are not indexed.
+  static constexpr size_t MinIndexedSize = 16;
+
+  /// Returns the position of the first of Items for which
+  /// GetName returns Name.
+  template <typename ListT, typename GetNameT>
+  std::optional<unsigned> find(const ListT &Items,
+                               StringRef Name,
+                               GetNameT GetName) {
+    if (Items.size() < MinIndexedSize) {
+      for (unsigned I = 0, E = Items.size(); I != E; ++I)
+        if (GetName(Items[I]) == Name)
+          return I;
+      return std::nullopt;
+    }
+    if (!Built.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> Guard(Mutex);
+      if (!Built.load(std::memory_order_relaxed)) {
+        for (unsigned I = 0, E = Items.size(); I != E; ++I)
+          Positions.try_emplace(GetName(Items[I]), I);
+        Built.store(true, std::memory_order_release);
+      }
+    }
+    auto I = Positions.find(Name);
+    if (I == Positions.end())
+      return std::nullopt;
+    return I->second;
+  }
+
+  /// Forgets the positions after the list changed. Must not
+  /// race with find().
+  void clear() {
+    Positions.clear();
+    Built.store(false, std::memory_order_relaxed);
+  }
+};
+
 class Field {
-  SMLoc Loc;
-  StringRef Name;
+  SourceOffset Loc;
+  Identifier Name;
   TypeDeclaration *Type;
 
 public:
-  Field(SMLoc Loc, const StringRef &Name,
+  Field(SourceOffset Loc, Identifier Name,
         TypeDeclaration *Type)
       : Loc(Loc), Name(Name), Type(Type) {}
-  SMLoc getLoc() const { return Loc; }
-  const StringRef &getName() const { return Name; }
+  SourceOffset getLoc() const { return Loc; }
+  StringRef getName() const { return Name.getName(); }
   TypeDeclaration *getType() const { return Type; }
 };
 using FieldList = std::vector<Field>;
 
+// Nodes are allocated in the arenas of the ASTContext, and
+// the child lists are copied there once they are complete.
+// The kinds and flags of a node share a word with its
+// source offset.
+
 class Decl {
 public:
   enum DeclKind {
@@ -57,44 +143,83 @@ public:
   };
 
 private:
-  const DeclKind Kind;
+  unsigned Kind : 8;
 
 protected:
+  // Flags of the subclasses.
+  unsigned IsVar : 1;
+  unsigned BodySkipped : 1;
+
+  SourceOffset Loc;
   Decl *EnclosingDecL;
-  SMLoc Loc;
-  StringRef Name;
+  Identifier Name;
 
 public:
-  Decl(DeclKind Kind, Decl *EnclosingDecL, SMLoc Loc,
-       StringRef Name)
-      : Kind(Kind), EnclosingDecL(EnclosingDecL), Loc(Loc),
+  Decl(DeclKind Kind, Decl *EnclosingDecL, SourceOffset Loc,
+       Identifier Name)
+      : Kind(Kind), IsVar(false), BodySkipped(false),
+        Loc(Loc), EnclosingDecL(EnclosingDecL),
         Name(Name) {}
 
-  DeclKind getKind() const { return Kind; }
-  SMLoc getLocation() { return Loc; }
-  StringRef getName() { return Name; }
+  DeclKind getKind() const {
+    return static_cast<DeclKind>(Kind);
+  }
+  SourceOffset getLocation() { return Loc; }
+  StringRef getName() { return Name.getName(); }
+  Identifier getIdentifier() { return Name; }
   Decl *getEnclosingDecl() { return EnclosingDecL; }
 };
 
+/// Provides the declarations of an imported module, so
+/// that only the used ones are created.
+class ExternalModuleSource {
+public:
+  virtual ~ExternalModuleSource() = default;
+
+  /// Returns the declaration Name of the module, or
+  /// nullptr. Safe to call from several threads.
+  virtual Decl *lookup(StringRef Name) = 0;
+};
+
+/// Must be registered with ASTContext::addDestruction().
 class ModuleDeclaration : public Decl {
-  DeclList Decls;
-  StmtList Stmts;
+  ArrayRef<Decl *> Decls;
+  ArrayRef<Stmt *> Stmts;
+  ExternalModuleSource *External = nullptr;
+  NameIndex Index;
 
 public:
-  ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                    StringRef Name)
+  ModuleDeclaration(Decl *EnclosingDecL, SourceOffset Loc,
+                    Identifier Name)
       : Decl(DK_Module, EnclosingDecL, Loc, Name) {}
 
-  ModuleDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                    StringRef Name, DeclList &Decls,
-                    StmtList &Stmts)
-      : Decl(DK_Module, EnclosingDecL, Loc, Name),
-        Decls(Decls), Stmts(Stmts) {}
+  ArrayRef<Decl *> getDecls() { return Decls; }
+  void setDecls(ArrayRef<Decl *> D) {
+    Decls = D;
+    Index.clear();
+  }
+  ArrayRef<Stmt *> getStmts() { return Stmts; }
+  void setStmts(ArrayRef<Stmt *> L) { Stmts = L; }
 
-  const DeclList &getDecls() { return Decls; }
-  void setDecls(DeclList &D) { Decls = D; }
-  const StmtList &getStmts() { return Stmts; }
-  void setStmts(StmtList &L) { Stmts = L; }
+  /// Returns the declaration Name of the module, or
+  /// nullptr.
+  Decl *lookup(StringRef Name) {
+    if (External)
+      return External->lookup(Name);
+    auto GetName = [](Decl *D) { return D->getName(); };
+    if (auto I = Index.find(Decls, Name, GetName))
+      return Decls[*I];
+    return nullptr;
+  }
+
+  /// An imported module has no Decls, but looks up its
+  /// declarations in the external source.
+  ExternalModuleSource *getExternalSource() {
+    return External;
+  }
+  void setExternalSource(ExternalModuleSource *Source) {
+    External = Source;
+  }
 
   static bool classof(const Decl *D) {
     return D->getKind() == DK_Module;
@@ -105,8 +230,8 @@ class ConstantDeclaration : public Decl {
   Expr *E;
 
 public:
-  ConstantDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                      StringRef Name, Expr *E)
+  ConstantDeclaration(Decl *EnclosingDecL, SourceOffset Loc,
+                      Identifier Name, Expr *E)
       : Decl(DK_Const, EnclosingDecL, Loc, Name), E(E) {}
 
   Expr *getExpr() { return E; }
@@ -119,7 +244,7 @@ public:
 class TypeDeclaration : public Decl {
 protected:
   TypeDeclaration(DeclKind Kind, Decl *EnclosingDecL,
-                  SMLoc Loc, StringRef Name)
+                  SourceOffset Loc, Identifier Name)
       : Decl(Kind, EnclosingDecL, Loc, Name) {}
 
 public:
@@ -133,8 +258,8 @@ class AliasTypeDeclaration : public TypeDeclaration {
   TypeDeclaration *Type;
 
 public:
-  AliasTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                       StringRef Name,
+  AliasTypeDeclaration(Decl *EnclosingDecL,
+                       SourceOffset Loc, Identifier Name,
                        TypeDeclaration *Type)
       : TypeDeclaration(DK_AliasType, EnclosingDecL, Loc,
                         Name),
@@ -152,9 +277,9 @@ class ArrayTypeDeclaration : public TypeDeclaration {
   TypeDeclaration *Type;
 
 public:
-  ArrayTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                       StringRef Name, Expr *Nums,
-                       TypeDeclaration *Type)
+  ArrayTypeDeclaration(Decl *EnclosingDecL,
+                       SourceOffset Loc, Identifier Name,
+                       Expr *Nums, TypeDeclaration *Type)
       : TypeDeclaration(DK_ArrayType, EnclosingDecL, Loc,
                         Name),
         Nums(Nums), Type(Type) {}
@@ -169,8 +294,9 @@ public:
 
 class PervasiveTypeDeclaration : public TypeDeclaration {
 public:
-  PervasiveTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                           StringRef Name)
+  PervasiveTypeDeclaration(Decl *EnclosingDecL,
+                           SourceOffset Loc,
+                           Identifier Name)
       : TypeDeclaration(DK_PervasiveType, EnclosingDecL,
                         Loc, Name) {}
 
@@ -183,8 +309,8 @@ class PointerTypeDeclaration : public TypeDeclaration {
   TypeDeclaration *Type;
 
 public:
-  PointerTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                         StringRef Name,
+  PointerTypeDeclaration(Decl *EnclosingDecL,
+                         SourceOffset Loc, Identifier Name,
                          TypeDeclaration *Type)
       : TypeDeclaration(DK_PointerType, EnclosingDecL, Loc,
                         Name),
@@ -197,18 +323,28 @@ public:
   }
 };
 
+/// Must be registered with ASTContext::addDestruction().
 class RecordTypeDeclaration : public TypeDeclaration {
-  FieldList Fields;
+  ArrayRef<Field> Fields;
+  mutable NameIndex Index;
 
 public:
-  RecordTypeDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                        StringRef Name,
-                        const FieldList &Fields)
+  RecordTypeDeclaration(Decl *EnclosingDecL,
+                        SourceOffset Loc, Identifier Name,
+                        ArrayRef<Field> Fields)
       : TypeDeclaration(DK_RecordType, EnclosingDecL, Loc,
                         Name),
         Fields(Fields) {}
 
-  const FieldList &getFields() const { return Fields; }
+  ArrayRef<Field> getFields() const { return Fields; }
+
+  /// Returns the position of the field Name.
+  std::optional<unsigned>
+  getFieldIndex(StringRef Name) const {
+    return Index.find(Fields, Name, [](const Field &F) {
+      return F.getName();
+    });
+  }
 
   static bool classof(const Decl *D) {
     return D->getKind() == DK_RecordType;
@@ -219,8 +355,8 @@ class VariableDeclaration : public Decl {
   TypeDeclaration *Ty;
 
 public:
-  VariableDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                      StringRef Name, TypeDeclaration *Ty)
+  VariableDeclaration(Decl *EnclosingDecL, SourceOffset Loc,
+                      Identifier Name, TypeDeclaration *Ty)
       : Decl(DK_Var, EnclosingDecL, Loc, Name), Ty(Ty) {}
 
   TypeDeclaration *getType() { return Ty; }
@@ -232,15 +368,16 @@ public:
 
 class FormalParameterDeclaration : public Decl {
   TypeDeclaration *Ty;
-  bool IsVar;
 
 public:
-  FormalParameterDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                             StringRef Name,
+  FormalParameterDeclaration(Decl *EnclosingDecL,
+                             SourceOffset Loc,
+                             Identifier Name,
                              TypeDeclaration *Ty,
                              bool IsVar)
-      : Decl(DK_Param, EnclosingDecL, Loc, Name), Ty(Ty),
-        IsVar(IsVar) {}
+      : Decl(DK_Param, EnclosingDecL, Loc, Name), Ty(Ty) {
+    this->IsVar = IsVar;
+  }
 
   TypeDeclaration *getType() const { return Ty; }
   bool isVar() const { return IsVar; }
@@ -251,42 +388,54 @@ public:
 };
 
 class ProcedureDeclaration : public Decl {
-  FormalParamList Params;
-  TypeDeclaration *RetType;
-  DeclList Decls;
-  StmtList Stmts;
-
-public:
-  ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                       StringRef Name)
+  ArrayRef<FormalParameterDeclaration *> Params;
+  TypeDeclaration *RetType = nullptr;
+  ArrayRef<Decl *> Decls;
+  ArrayRef<Stmt *> Stmts;
+  // Where a skipped body starts, and how many symbols of
+  // the module and pervasive scopes are visible in it.
+  SourceOffset BodyLoc;
+  unsigned NumVisibleDecls = 0;
+
+public:
+  ProcedureDeclaration(Decl *EnclosingDecL,
+                       SourceOffset Loc, Identifier Name)
       : Decl(DK_Proc, EnclosingDecL, Loc, Name) {}
 
-  ProcedureDeclaration(Decl *EnclosingDecL, SMLoc Loc,
-                       StringRef Name,
-                       FormalParamList &Params,
-                       TypeDeclaration *RetType,
-                       DeclList &Decls, StmtList &Stmts)
-      : Decl(DK_Proc, EnclosingDecL, Loc, Name),
-        Params(Params), RetType(RetType), Decls(Decls),
-        Stmts(Stmts) {}
-
-  const FormalParamList &getFormalParams() {
+  ArrayRef<FormalParameterDeclaration *> getFormalParams() {
     return Params;
   }
-  void setFormalParams(FormalParamList &FP) { Params = FP; }
+  void setFormalParams(
+      ArrayRef<FormalParameterDeclaration *> FP) {
+    Params = FP;
+  }
   TypeDeclaration *getRetType() { return RetType; }
   void setRetType(TypeDeclaration *Ty) { RetType = Ty; }
 
-  const DeclList &getDecls() { return Decls; }
-  void setDecls(DeclList &D) { Decls = D; }
-  const StmtList &getStmts() { return Stmts; }
-  void setStmts(StmtList &L) { Stmts = L; }
+  ArrayRef<Decl *> getDecls() { return Decls; }
+  void setDecls(ArrayRef<Decl *> D) { Decls = D; }
+  ArrayRef<Stmt *> getStmts() { return Stmts; }
+  void setStmts(ArrayRef<Stmt *> L) { Stmts = L; }
+
+  /// True if the body has been skipped and not yet parsed
+  /// (see Parser::setSkipBodies()).
+  bool hasSkippedBody() { return BodySkipped; }
+  SourceOffset getBodyLoc() { return BodyLoc; }
+  unsigned getNumVisibleDecls() { return NumVisibleDecls; }
+  void setSkippedBody(SourceOffset Loc,
+                      unsigned NumVisible) {
+    BodyLoc = Loc;
+    NumVisibleDecls = NumVisible;
+    BodySkipped = true;
+  }
+  void clearSkippedBody() { BodySkipped = false; }
 
   static bool classof(const Decl *D) {
     return D->getKind() == DK_Proc;
   }
 };
 
+/// An operator as the parser passes it to Sema.
 class OperatorInfo {
   SMLoc Loc;
   uint32_t Kind : 16;
@@ -320,16 +469,24 @@ public:
   };
 
 private:
-  const ExprKind Kind;
   TypeDeclaration *Ty;
-  bool IsConstant;
+  unsigned Kind : 3;
+  unsigned IsConstant : 1;
 
 protected:
+  // Fields of the subclasses.
+  unsigned OperatorKind : 16;
+  unsigned BoolValue : 1;
+  SourceOffset Loc;
+
   Expr(ExprKind Kind, TypeDeclaration *Ty, bool IsConst)
-      : Kind(Kind), Ty(Ty), IsConstant(IsConst) {}
+      : Ty(Ty), Kind(Kind), IsConstant(IsConst),
+        OperatorKind(tok::unknown), BoolValue(false) {}
 
 public:
-  ExprKind getKind() const { return Kind; }
+  ExprKind getKind() const {
+    return static_cast<ExprKind>(Kind);
+  }
   TypeDeclaration *getType() { return Ty; }
   void setType(TypeDeclaration *T) { Ty = T; }
   bool isConst() { return IsConstant; }
@@ -338,17 +495,23 @@ public:
 class InfixExpression : public Expr {
   Expr *Left;
   Expr *Right;
-  const OperatorInfo Op;
 
 public:
-  InfixExpression(Expr *Left, Expr *Right, OperatorInfo Op,
+  InfixExpression(Expr *Left, Expr *Right,
+                  tok::TokenKind Op, SourceOffset OpLoc,
                   TypeDeclaration *Ty, bool IsConst)
       : Expr(EK_Infix, Ty, IsConst), Left(Left),
-        Right(Right), Op(Op) {}
+        Right(Right) {
+    OperatorKind = Op;
+    Loc = OpLoc;
+  }
 
   Expr *getLeft() { return Left; }
   Expr *getRight() { return Right; }
-  const OperatorInfo &getOperatorInfo() { return Op; }
+  tok::TokenKind getOperatorKind() const {
+    return static_cast<tok::TokenKind>(OperatorKind);
+  }
+  SourceOffset getOperatorLoc() const { return Loc; }
 
   static bool classof(const Expr *E) {
     return E->getKind() == EK_Infix;
@@ -357,15 +520,21 @@ public:
 
 class PrefixExpression : public Expr {
   Expr *E;
-  const OperatorInfo Op;
 
 public:
-  PrefixExpression(Expr *E, OperatorInfo Op,
-                   TypeDeclaration *Ty, bool IsConst)
-      : Expr(EK_Prefix, Ty, IsConst), E(E), Op(Op) {}
+  PrefixExpression(Expr *E, tok::TokenKind Op,
+                   SourceOffset OpLoc, TypeDeclaration *Ty,
+                   bool IsConst)
+      : Expr(EK_Prefix, Ty, IsConst), E(E) {
+    OperatorKind = Op;
+    Loc = OpLoc;
+  }
 
   Expr *getExpr() { return E; }
-  const OperatorInfo &getOperatorInfo() { return Op; }
+  tok::TokenKind getOperatorKind() const {
+    return static_cast<tok::TokenKind>(OperatorKind);
+  }
+  SourceOffset getOperatorLoc() const { return Loc; }
 
   static bool classof(const Expr *E) {
     return E->getKind() == EK_Prefix;
@@ -373,13 +542,16 @@ public:
 };
 
 class IntegerLiteral : public Expr {
-  SMLoc Loc;
   llvm::APSInt Value;
 
 public:
-  IntegerLiteral(SMLoc Loc, const llvm::APSInt &Value,
+  IntegerLiteral(SourceOffset Loc,
+                 const llvm::APSInt &Value,
                  TypeDeclaration *Ty)
-      : Expr(EK_Int, Ty, true), Loc(Loc), Value(Value) {}
+      : Expr(EK_Int, Ty, true), Value(Value) {
+    this->Loc = Loc;
+  }
+  SourceOffset getLocation() const { return Loc; }
   llvm::APSInt &getValue() { return Value; }
 
   static bool classof(const Expr *E) {
@@ -388,18 +560,20 @@ public:
 };
 
 class BooleanLiteral : public Expr {
-  bool Value;
-
 public:
   BooleanLiteral(bool Value, TypeDeclaration *Ty)
-      : Expr(EK_Bool, Ty, true), Value(Value) {}
-  bool getValue() { return Value; }
+      : Expr(EK_Bool, Ty, true) {
+    BoolValue = Value;
+  }
+  bool getValue() { return BoolValue; }
 
   static bool classof(const Expr *E) {
     return E->getKind() == EK_Bool;
   }
 };
 
+/// The selectors of a designator form a singly linked
+/// list, as they are added one at a time.
 class Selector {
 public:
   enum SelectorKind {
@@ -409,19 +583,24 @@ public:
   };
 
 private:
-  const SelectorKind Kind;
-
   // The type decribes the base type.
   // E.g. the component type of an index selector
   TypeDeclaration *Type;
+  Selector *Next = nullptr;
+  unsigned Kind : 2;
+
+  friend class Designator;
 
 protected:
   Selector(SelectorKind Kind, TypeDeclaration *Type)
-      : Kind(Kind), Type(Type) {}
+      : Type(Type), Kind(Kind) {}
 
 public:
-  SelectorKind getKind() const { return Kind; }
+  SelectorKind getKind() const {
+    return static_cast<SelectorKind>(Kind);
+  }
   TypeDeclaration *getType() const { return Type; }
+  Selector *getNext() const { return Next; }
 };
 
 class IndexSelector : public Selector {
@@ -440,16 +619,16 @@ public:
 
 class FieldSelector : public Selector {
   uint32_t Index;
-  StringRef Name;
+  Identifier Name;
 
 public:
-  FieldSelector(uint32_t Index, StringRef Name,
+  FieldSelector(uint32_t Index, Identifier Name,
                 TypeDeclaration *Type)
       : Selector(SK_Field, Type), Index(Index), Name(Name) {
   }
 
   uint32_t getIndex() const { return Index; }
-  const StringRef &getname() const { return Name; }
+  StringRef getname() const { return Name.getName(); }
 
   static bool classof(const Selector *Sel) {
     return Sel->getKind() == SK_Field;
@@ -466,9 +645,30 @@ public:
   }
 };
 
+class SelectorIterator
+    : public llvm::iterator_facade_base<
+          SelectorIterator, std::forward_iterator_tag,
+          Selector *, std::ptrdiff_t, Selector **,
+          Selector *> {
+  Selector *Cur = nullptr;
+
+public:
+  SelectorIterator() = default;
+  explicit SelectorIterator(Selector *Sel) : Cur(Sel) {}
+
+  bool operator==(const SelectorIterator &Other) const {
+    return Cur == Other.Cur;
+  }
+  Selector *operator*() const { return Cur; }
+  SelectorIterator &operator++() {
+    Cur = Cur->getNext();
+    return *this;
+  }
+};
+
 class Designator : public Expr {
   Decl *Var;
-  SelectorList Selectors;
+  Selector *Selectors = nullptr;
 
 public:
   Designator(VariableDeclaration *Var)
@@ -479,13 +679,18 @@ public:
         Var(Param) {}
 
   void addSelector(Selector *Sel) {
-    Selectors.push_back(Sel);
+    Selector **Last = &Selectors;
+    while (*Last)
+      Last = &(*Last)->Next;
+    *Last = Sel;
     setType(Sel->getType());
   }
 
   Decl *getDecl() { return Var; }
-  const SelectorList &getSelectors() const {
-    return Selectors;
+  llvm::iterator_range<SelectorIterator>
+  getSelectors() const {
+    return {SelectorIterator(Selectors),
+            SelectorIterator()};
   }
 
   static bool classof(const Expr *E) {
@@ -508,18 +713,38 @@ public:
   }
 };
 
-class FunctionCallExpr : public Expr {
+class FunctionCallExpr final
+    : public Expr,
+      private llvm::TrailingObjects<FunctionCallExpr,
+                                    Expr *> {
+  friend TrailingObjects;
+
   ProcedureDeclaration *Proc;
-  ExprList Params;
+  unsigned NumParams;
 
-public:
   FunctionCallExpr(ProcedureDeclaration *Proc,
-                   ExprList Params)
+                   ArrayRef<Expr *> Params)
       : Expr(EK_Func, Proc->getRetType(), false),
-        Proc(Proc), Params(Params) {}
+        Proc(Proc), NumParams(Params.size()) {
+    std::uninitialized_copy(Params.begin(), Params.end(),
+                            getTrailingObjects<Expr *>());
+  }
+
+public:
+  static FunctionCallExpr *
+  create(llvm::BumpPtrAllocator &Alloc,
+         ProcedureDeclaration *Proc,
+         ArrayRef<Expr *> Params) {
+    void *Mem = Alloc.Allocate(
+        totalSizeToAlloc<Expr *>(Params.size()),
+        alignof(FunctionCallExpr));
+    return new (Mem) FunctionCallExpr(Proc, Params);
+  }
 
   ProcedureDeclaration *geDecl() { return Proc; }
-  const ExprList &getParams() { return Params; }
+  ArrayRef<Expr *> getParams() const {
+    return {getTrailingObjects<Expr *>(), NumParams};
+  }
 
   static bool classof(const Expr *E) {
     return E->getKind() == EK_Func;
@@ -537,13 +762,15 @@ public:
   };
 
 private:
-  const StmtKind Kind;
+  unsigned Kind : 3;
 
 protected:
   Stmt(StmtKind Kind) : Kind(Kind) {}
 
 public:
-  StmtKind getKind() const { return Kind; }
+  StmtKind getKind() const {
+    return static_cast<StmtKind>(Kind);
+  }
 };
 
 class AssignmentStatement : public Stmt {
@@ -562,53 +789,122 @@ public:
   }
 };
 
-class ProcedureCallStatement : public Stmt {
+class ProcedureCallStatement final
+    : public Stmt,
+      private llvm::TrailingObjects<ProcedureCallStatement,
+                                    Expr *> {
+  friend TrailingObjects;
+
+  unsigned NumParams;
   ProcedureDeclaration *Proc;
-  ExprList Params;
 
-public:
   ProcedureCallStatement(ProcedureDeclaration *Proc,
-                         ExprList &Params)
-      : Stmt(SK_ProcCall), Proc(Proc), Params(Params) {}
+                         ArrayRef<Expr *> Params)
+      : Stmt(SK_ProcCall), NumParams(Params.size()),
+        Proc(Proc) {
+    std::uninitialized_copy(Params.begin(), Params.end(),
+                            getTrailingObjects<Expr *>());
+  }
+
+public:
+  static ProcedureCallStatement *
+  create(llvm::BumpPtrAllocator &Alloc,
+         ProcedureDeclaration *Proc,
+         ArrayRef<Expr *> Params) {
+    void *Mem = Alloc.Allocate(
+        totalSizeToAlloc<Expr *>(Params.size()),
+        alignof(ProcedureCallStatement));
+    return new (Mem) ProcedureCallStatement(Proc, Params);
+  }
 
   ProcedureDeclaration *getProc() { return Proc; }
-  const ExprList &getParams() { return Params; }
+  ArrayRef<Expr *> getParams() const {
+    return {getTrailingObjects<Expr *>(), NumParams};
+  }
 
   static bool classof(const Stmt *S) {
     return S->getKind() == SK_ProcCall;
   }
 };
 
-class IfStatement : public Stmt {
+/// The statements of both branches follow the node, the
+/// ones of the ELSE branch last.
+class IfStatement final
+    : public Stmt,
+      private llvm::TrailingObjects<IfStatement, Stmt *> {
+  friend TrailingObjects;
+
+  unsigned NumIfStmts;
+  unsigned NumElseStmts;
   Expr *Cond;
-  StmtList IfStmts;
-  StmtList ElseStmts;
+
+  IfStatement(Expr *Cond, ArrayRef<Stmt *> IfStmts,
+              ArrayRef<Stmt *> ElseStmts)
+      : Stmt(SK_If), NumIfStmts(IfStmts.size()),
+        NumElseStmts(ElseStmts.size()), Cond(Cond) {
+    Stmt **Stmts = getTrailingObjects<Stmt *>();
+    std::uninitialized_copy(IfStmts.begin(), IfStmts.end(),
+                            Stmts);
+    std::uninitialized_copy(ElseStmts.begin(),
+                            ElseStmts.end(),
+                            Stmts + NumIfStmts);
+  }
 
 public:
-  IfStatement(Expr *Cond, StmtList &IfStmts,
-              StmtList &ElseStmts)
-      : Stmt(SK_If), Cond(Cond), IfStmts(IfStmts),
-        ElseStmts(ElseStmts) {}
+  static IfStatement *create(llvm::BumpPtrAllocator &Alloc,
+                             Expr *Cond,
+                             ArrayRef<Stmt *> IfStmts,
+                             ArrayRef<Stmt *> ElseStmts) {
+    void *Mem = Alloc.Allocate(
+        totalSizeToAlloc<Stmt *>(IfStmts.size() +
+                                 ElseStmts.size()),
+        alignof(IfStatement));
+    return new (Mem) IfStatement(Cond, IfStmts, ElseStmts);
+  }
 
   Expr *getCond() { return Cond; }
-  const StmtList &getIfStmts() { return IfStmts; }
-  const StmtList &getElseStmts() { return ElseStmts; }
+  ArrayRef<Stmt *> getIfStmts() const {
+    return {getTrailingObjects<Stmt *>(), NumIfStmts};
+  }
+  ArrayRef<Stmt *> getElseStmts() const {
+    return {getTrailingObjects<Stmt *>() + NumIfStmts,
+            NumElseStmts};
+  }
 
   static bool classof(const Stmt *S) {
     return S->getKind() == SK_If;
   }
 };
 
-class WhileStatement : public Stmt {
+class WhileStatement final
+    : public Stmt,
+      private llvm::TrailingObjects<WhileStatement,
+                                    Stmt *> {
+  friend TrailingObjects;
+
+  unsigned NumStmts;
   Expr *Cond;
-  StmtList Stmts;
+
+  WhileStatement(Expr *Cond, ArrayRef<Stmt *> Stmts)
+      : Stmt(SK_While), NumStmts(Stmts.size()), Cond(Cond) {
+    std::uninitialized_copy(Stmts.begin(), Stmts.end(),
+                            getTrailingObjects<Stmt *>());
+  }
 
 public:
-  WhileStatement(Expr *Cond, StmtList &Stmts)
-      : Stmt(SK_While), Cond(Cond), Stmts(Stmts) {}
+  static WhileStatement *
+  create(llvm::BumpPtrAllocator &Alloc, Expr *Cond,
+         ArrayRef<Stmt *> Stmts) {
+    void *Mem = Alloc.Allocate(
+        totalSizeToAlloc<Stmt *>(Stmts.size()),
+        alignof(WhileStatement));
+    return new (Mem) WhileStatement(Cond, Stmts);
+  }
 
   Expr *getCond() { return Cond; }
-  const StmtList &getWhileStmts() { return Stmts; }
+  ArrayRef<Stmt *> getWhileStmts() const {
+    return {getTrailingObjects<Stmt *>(), NumStmts};
+  }
 
   static bool classof(const Stmt *S) {
     return S->getKind() == SK_While;
@@ -629,5 +925,10 @@ public:
   }
 };
 
+static_assert(sizeof(Decl) <= 3 * sizeof(void *),
+              "Decl should stay small");
+static_assert(sizeof(Expr) <= 2 * sizeof(void *),
+              "Expr should stay small");
+
 } // namespace tinylang
-#endif
\ No newline at end of file
+#endif
@@ -1,18 +1,61 @@
 #ifndef TINYLANG_AST_ASTCONTEXT_H
 #define TINYLANG_AST_ASTCONTEXT_H
 
+#include "tinylang/AST/AST.h"
 #include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/SourceMgr.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace tinylang {
 
+/// Owns the AST of a compilation. Nodes are allocated with
+/// placement new from an arena, and live as long as the
+/// context; their destructors are not run, unless they
+/// were registered with addDestruction().
 class ASTContext {
   llvm::SourceMgr &SrcMgr;
   StringRef Filename;
 
+  llvm::BumpPtrAllocator Allocator;
+
+  // Guards the two members below, which are shared by the
+  // threads parsing procedure bodies.
+  std::mutex Mutex;
+  std::vector<std::unique_ptr<llvm::BumpPtrAllocator>>
+      ThreadAllocators;
+  std::vector<std::pair<void (*)(void *), void *>>
+      Destructions;
+
+  // Identifiers are interned on every thread, so the table
+  // is split by hash, each part with its own lock. Parts
+  // sit on separate cache lines.
+  struct alignas(64) IdentifierShard {
+    std::mutex Mutex;
+    llvm::StringMap<char, llvm::BumpPtrAllocator> Names;
+  };
+  static constexpr size_t NumIdentifierShards = 16;
+  std::array<IdentifierShard, NumIdentifierShards>
+      Identifiers;
+
 public:
   ASTContext(llvm::SourceMgr &SrcMgr, StringRef Filename)
       : SrcMgr(SrcMgr), Filename(Filename) {}
+  ASTContext(const ASTContext &) = delete;
+  ASTContext &operator=(const ASTContext &) = delete;
+
+  ~ASTContext() {
+    for (auto &[Destroy, Ptr] : Destructions)
+      Destroy(Ptr);
+  }
 
   StringRef getFilename() { return Filename; }
 
@@ -20,8 +63,55 @@ public:
   const llvm::SourceMgr &getSourceMgr() const {
     return SrcMgr;
   }
+
+  /// The arena of the thread which parses the module.
+  llvm::BumpPtrAllocator &getAllocator() {
+    return Allocator;
+  }
+
+  /// Returns a new arena for another thread. It lives as
+  /// long as the context.
+  llvm::BumpPtrAllocator &createAllocator() {
+    std::lock_guard<std::mutex> Guard(Mutex);
+    ThreadAllocators.push_back(
+        std::make_unique<llvm::BumpPtrAllocator>());
+    return *ThreadAllocators.back();
+  }
+
+  /// Runs the destructor of Node, which was allocated in an
+  /// arena of this context, when the context is destroyed.
+  template <typename T> void addDestruction(T *Node) {
+    std::lock_guard<std::mutex> Guard(Mutex);
+    Destructions.emplace_back(
+        [](void *Ptr) { static_cast<T *>(Ptr)->~T(); },
+        Node);
+  }
+
+  /// Returns the unique identifier with the name Name.
+  Identifier getIdentifier(StringRef Name) {
+    IdentifierShard &Shard =
+        Identifiers[llvm::hash_value(Name) %
+                    NumIdentifierShards];
+    std::lock_guard<std::mutex> Guard(Shard.Mutex);
+    return Identifier(
+        &*Shard.Names.try_emplace(Name).first);
+  }
+
+  /// Copies Items into Alloc, which must be an arena of
+  /// this context.
+  template <typename T>
+  static ArrayRef<T>
+  copyArray(llvm::BumpPtrAllocator &Alloc,
+            ArrayRef<T> Items) {
+    if (Items.empty())
+      return ArrayRef<T>();
+    T *Mem = Alloc.Allocate<T>(Items.size());
+    std::uninitialized_copy(Items.begin(), Items.end(),
+                            Mem);
+    return ArrayRef<T>(Mem, Items.size());
+  }
 };
 
 } // namespace tinylang
 
-#endif
\ No newline at end of file
+#endif
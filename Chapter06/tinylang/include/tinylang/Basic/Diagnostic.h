@@ -2,12 +2,17 @@
 #define TINYLANG_BASIC_DIAGNOSTIC_H
 
 #include "tinylang/Basic/LLVM.h"
+#include "tinylang/Basic/SourceOffset.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace tinylang {
 
@@ -18,33 +23,135 @@ enum {
 };
 } // namespace diag
 
+class DiagnosticsEngine;
+
+/// A diagnostic as it is handed to a DiagnosticConsumer.
+/// The message is only formatted when asked for, so a
+/// diagnostic which is dropped costs no formatting.
+class Diagnostic {
+  const SourceMgr &SrcMgr;
+  SMLoc Loc;
+  unsigned ID;
+  SourceMgr::DiagKind Kind;
+  llvm::function_ref<std::string()> Format;
+
+public:
+  Diagnostic(const SourceMgr &SrcMgr, SMLoc Loc,
+             unsigned ID, SourceMgr::DiagKind Kind,
+             llvm::function_ref<std::string()> Format)
+      : SrcMgr(SrcMgr), Loc(Loc), ID(ID), Kind(Kind),
+        Format(Format) {}
+
+  const SourceMgr &getSourceMgr() const { return SrcMgr; }
+  SMLoc getLocation() const { return Loc; }
+  unsigned getID() const { return ID; }
+  SourceMgr::DiagKind getKind() const { return Kind; }
+  std::string getMessage() const { return Format(); }
+};
+
+/// Receives the diagnostics reported to a
+/// DiagnosticsEngine.
+class DiagnosticConsumer {
+public:
+  virtual ~DiagnosticConsumer();
+
+  virtual void handleDiagnostic(const Diagnostic &D) = 0;
+
+  /// Called after the last diagnostic, for consumers which
+  /// write their output at once.
+  virtual void finish() {}
+};
+
+/// Keeps diagnostics until flushTo() is called. This lets
+/// diagnostics be reported on another thread, and be
+/// printed in source order later.
+class DiagnosticBuffer : public DiagnosticConsumer {
+  struct BufferedDiagnostic {
+    SMLoc Loc;
+    unsigned ID;
+    std::string Msg;
+  };
+  std::vector<BufferedDiagnostic> Buffered;
+
+public:
+  void handleDiagnostic(const Diagnostic &D) override {
+    Buffered.push_back(
+        {D.getLocation(), D.getID(), D.getMessage()});
+  }
+
+  /// Reports the buffered diagnostics through Diags, in
+  /// the order they were reported here.
+  void flushTo(DiagnosticsEngine &Diags);
+};
+
 class DiagnosticsEngine {
+  friend class DiagnosticBuffer;
+
   static const char *getDiagnosticText(unsigned DiagID);
   static SourceMgr::DiagKind
   getDiagnosticKind(unsigned DiagID);
 
   SourceMgr &SrcMgr;
-  unsigned NumErrors;
+  DiagnosticConsumer *Client;
+  std::unique_ptr<DiagnosticConsumer> OwnedClient;
+  unsigned NumErrors = 0;
+  unsigned ErrorLimit = 0;
+  bool FatalErrorOccurred = false;
+  // Notes belong to the diagnostic before them, and are
+  // dropped with it.
+  bool LastDiagnosticDropped = false;
+
+  void emit(SMLoc Loc, unsigned DiagID,
+            llvm::function_ref<std::string()> Format);
 
 public:
-  DiagnosticsEngine(SourceMgr &SrcMgr)
-      : SrcMgr(SrcMgr), NumErrors(0) {}
+  /// Prints diagnostics to stderr.
+  explicit DiagnosticsEngine(SourceMgr &SrcMgr);
+
+  /// Passes diagnostics to Client, which must outlive the
+  /// engine.
+  DiagnosticsEngine(SourceMgr &SrcMgr,
+                    DiagnosticConsumer &Client)
+      : SrcMgr(SrcMgr), Client(&Client) {}
+
+  SourceMgr &getSourceMgr() { return SrcMgr; }
+
+  /// Returns the name of the diagnostic, e.g.
+  /// "err_expected".
+  static StringRef getDiagnosticName(unsigned DiagID);
+
+  /// After Limit errors (0 = no limit), one more error is
+  /// reported as fatal, and all later diagnostics are
+  /// dropped.
+  void setErrorLimit(unsigned Limit) { ErrorLimit = Limit; }
+  unsigned getErrorLimit() const { return ErrorLimit; }
+
+  /// True once the error limit was exceeded. The lexer then
+  /// ends the input, so that parsing stops early.
+  bool hasFatalErrorOccurred() const {
+    return FatalErrorOccurred;
+  }
 
   unsigned numErrors() { return NumErrors; }
 
   template <typename... Args>
   void report(SMLoc Loc, unsigned DiagID,
               Args &&... Arguments) {
-    std::string Msg =
-        llvm::formatv(getDiagnosticText(DiagID),
-                      std::forward<Args>(Arguments)...)
-            .str();
-    SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-    SrcMgr.PrintMessage(Loc, Kind, Msg);
-    NumErrors += (Kind == SourceMgr::DK_Error);
+    emit(Loc, DiagID, [&] {
+      return llvm::formatv(getDiagnosticText(DiagID),
+                           Arguments...)
+          .str();
+    });
+  }
+
+  template <typename... Args>
+  void report(SourceOffset Loc, unsigned DiagID,
+              Args &&... Arguments) {
+    report(Loc.getLoc(SrcMgr), DiagID,
+           std::forward<Args>(Arguments)...);
   }
 };
 
 } // namespace tinylang
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+#ifndef TINYLANG_BASIC_DIAGNOSTICPRINTER_H
+#define TINYLANG_BASIC_DIAGNOSTICPRINTER_H
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "llvm/Support/JSON.h"
+#include <memory>
+
+namespace tinylang {
+
+enum class DiagnosticFormat { Text, JSON, SARIF };
+
+/// Prints diagnostics like the compilers of LLVM, with the
+/// source line and a caret.
+class TextDiagnosticPrinter : public DiagnosticConsumer {
+  raw_ostream &OS;
+
+public:
+  TextDiagnosticPrinter(raw_ostream &OS) : OS(OS) {}
+
+  void handleDiagnostic(const Diagnostic &D) override;
+};
+
+/// Prints each diagnostic as a JSON object on a line of its
+/// own, as soon as it is reported.
+class JSONDiagnosticPrinter : public DiagnosticConsumer {
+  raw_ostream &OS;
+
+public:
+  JSONDiagnosticPrinter(raw_ostream &OS) : OS(OS) {}
+
+  void handleDiagnostic(const Diagnostic &D) override;
+};
+
+/// Collects the diagnostics into a SARIF 2.1.0 log, which
+/// finish() prints.
+class SARIFDiagnosticPrinter : public DiagnosticConsumer {
+  raw_ostream &OS;
+  llvm::json::Array Results;
+
+public:
+  SARIFDiagnosticPrinter(raw_ostream &OS) : OS(OS) {}
+
+  void handleDiagnostic(const Diagnostic &D) override;
+  void finish() override;
+};
+
+std::unique_ptr<DiagnosticConsumer>
+createDiagnosticPrinter(DiagnosticFormat Format,
+                        raw_ostream &OS);
+
+} // namespace tinylang
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TINYLANG_BASIC_SOURCEOFFSET_H
+#define TINYLANG_BASIC_SOURCEOFFSET_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/Support/SMLoc.h"
+#include "llvm/Support/SourceMgr.h"
+#include <cstdint>
+
+namespace tinylang {
+
+/// A location in the main buffer of a SourceMgr, stored as
+/// a 32-bit offset instead of a pointer, so that AST nodes
+/// can pack it next to other small fields. Declarations
+/// which do not come from the source, like those of
+/// imported modules, have an invalid offset.
+class SourceOffset {
+  // The offset plus one; 0 is invalid.
+  uint32_t Raw = 0;
+
+public:
+  SourceOffset() = default;
+
+  static SourceOffset get(const SourceMgr &SrcMgr,
+                          SMLoc Loc) {
+    SourceOffset Offset;
+    if (!Loc.isValid() || !SrcMgr.getNumBuffers())
+      return Offset;
+    const llvm::MemoryBuffer *Buffer =
+        SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID());
+    const char *Ptr = Loc.getPointer();
+    if (Ptr >= Buffer->getBufferStart() &&
+        Ptr <= Buffer->getBufferEnd() &&
+        Ptr - Buffer->getBufferStart() < UINT32_MAX)
+      Offset.Raw = Ptr - Buffer->getBufferStart() + 1;
+    return Offset;
+  }
+
+  bool isValid() const { return Raw != 0; }
+
+  SMLoc getLoc(const SourceMgr &SrcMgr) const {
+    if (!isValid())
+      return SMLoc();
+    const llvm::MemoryBuffer *Buffer =
+        SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID());
+    return SMLoc::getFromPointer(Buffer->getBufferStart() +
+                                 Raw - 1);
+  }
+};
+
+} // namespace tinylang
+#endif
@@ -93,7 +93,7 @@ protected:
   void emitStmt(IfStatement *Stmt);
   void emitStmt(WhileStatement *Stmt);
   void emitStmt(ReturnStatement *Stmt);
-  void emit(const StmtList &Stmts);
+  void emit(ArrayRef<Stmt *> Stmts);
 
 public:
   CGProcedure(CGModule &CGM)
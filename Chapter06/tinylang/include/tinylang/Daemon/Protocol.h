@@ -0,0 +1,67 @@
+#ifndef TINYLANG_DAEMON_PROTOCOL_H
+#define TINYLANG_DAEMON_PROTOCOL_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace tinylang {
+namespace daemon {
+
+// The compiler daemon listens on a local socket. A client
+// connects, sends one request and reads one response, and
+// the connection is closed. Both are lists of strings:
+//
+//   Request:  working directory, argv[0], arguments...
+//   Response: exit code, output for stderr
+//
+// A list is a 32 bit little endian count, followed by each
+// string as a 32 bit length and its bytes.
+
+/// Environment variable naming the socket of the daemon.
+constexpr const char *SocketEnvVar = "TINYLANG_DAEMON_SOCKET";
+
+/// Seconds the daemon waits for the request of a client.
+constexpr int RequestTimeoutSeconds = 10;
+
+/// Returns the socket named by SocketEnvVar, or a socket in
+/// a directory of the current user in the temporary
+/// directory, which is created if needed.
+std::string getSocketPath();
+
+/// Returns a socket listening at Path, or -1 with an error
+/// message in Error. The directory of Path must belong to
+/// the current user, and not be writable by others. A
+/// socket left behind by a daemon which is gone is
+/// replaced.
+int listenAt(StringRef Path, std::string &Error);
+
+/// Returns a socket connected to the daemon listening at
+/// Path, or -1 if there is none or it runs as another
+/// user.
+int connectTo(StringRef Path);
+
+/// Waits for a client of the current user to connect to
+/// socket FD; others are turned away. Returns the socket of
+/// the connection, which times out reading after
+/// RequestTimeoutSeconds, or -1 on error.
+int acceptClient(int FD);
+
+/// Closes socket FD.
+void closeSocket(int FD);
+
+/// Sends the strings over socket FD. Returns false on
+/// error.
+bool sendStrings(int FD,
+                 llvm::ArrayRef<std::string> Strings);
+
+/// Receives strings sent with sendStrings(). Returns false
+/// on error.
+bool receiveStrings(int FD,
+                    std::vector<std::string> &Strings);
+
+} // namespace daemon
+} // namespace tinylang
+#endif
@@ -43,6 +43,8 @@ class Lexer {
 
   KeywordFilter Keywords;
 
+  bool ReportErrors = true;
+
 public:
   Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags)
       : SrcMgr(SrcMgr), Diags(Diags) {
@@ -62,6 +64,16 @@ public:
   /// Gets source code buffer.
   StringRef getBuffer() const { return CurBuf; }
 
+  /// Continues lexing at Loc, which must be the location
+  /// of a token returned earlier.
+  void restore(SMLoc Loc) { CurPtr = Loc.getPointer(); }
+
+  /// Without Report, lexical errors are not reported. This
+  /// is for input that is lexed again later.
+  void setReportErrors(bool Report) {
+    ReportErrors = Report;
+  }
+
 private:
   void identifier(Token &Result);
   void number(Token &Result);
@@ -8,6 +8,10 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+namespace llvm {
+class ThreadPool;
+} // namespace llvm
+
 namespace tinylang {
 
 class Parser {
@@ -18,6 +22,8 @@ class Parser {
 
   Token Tok;
 
+  bool SkipBodies = false;
+
   DiagnosticsEngine &getDiagnostics() const {
     return Lex.getDiagnostics();
   }
@@ -71,6 +77,7 @@ class Parser {
   bool parseField(FieldList &Fields);
   bool parseVariableDeclaration(DeclList &Decls);
   bool parseProcedureDeclaration(DeclList &ParentDecls);
+  bool skipProcedureBody();
   bool parseFormalParameters(FormalParamList &Params,
                              Decl *&RetType);
   bool parseFormalParameterList(FormalParamList &Params);
@@ -96,6 +103,28 @@ public:
   Parser(Lexer &Lex, Sema &Actions);
 
   ModuleDeclaration *parse();
+
+  /// With Skip, the bodies of the module's procedures are
+  /// not parsed but only skipped over, so that parse()
+  /// checks just the declarations. This is much faster
+  /// when only the interface of a module is needed.
+  void setSkipBodies(bool Skip) { SkipBodies = Skip; }
+
+  /// Parses the skipped body of D after parse() has
+  /// returned. The body sees the same declarations as if it
+  /// had been parsed in place. Returns true on error.
+  bool parseSkippedBody(ProcedureDeclaration *D);
+
+  /// Parses all skipped bodies of Mod's procedures.
+  bool parseSkippedBodies(ModuleDeclaration *Mod);
+
+  /// Parses all skipped bodies of Mod's procedures on the
+  /// threads of Pool, and waits for them. Each thread uses
+  /// a lexer and a Sema of its own. Their diagnostics are
+  /// reported afterwards, in source order, so the output
+  /// is the same as with the serial version.
+  bool parseSkippedBodies(ModuleDeclaration *Mod,
+                          llvm::ThreadPool &Pool);
 };
 } // namespace tinylang
 #endif
\ No newline at end of file
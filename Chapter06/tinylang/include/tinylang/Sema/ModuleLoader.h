@@ -0,0 +1,25 @@
+#ifndef TINYLANG_SEMA_MODULELOADER_H
+#define TINYLANG_SEMA_MODULELOADER_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/SMLoc.h"
+
+namespace tinylang {
+
+class ModuleDeclaration;
+
+/// Finds the modules named in imports.
+class ModuleLoader {
+public:
+  virtual ~ModuleLoader() = default;
+
+  /// Returns the module Name, whose declarations are
+  /// provided by its external source. Returns nullptr
+  /// after reporting an error at Loc if the module can not
+  /// be loaded.
+  virtual ModuleDeclaration *loadModule(SMLoc Loc,
+                                        StringRef Name) = 0;
+};
+} // namespace tinylang
+#endif
@@ -2,27 +2,66 @@
 #define TINYLANG_SEMA_SEMA_H
 
 #include "tinylang/AST/AST.h"
+#include "tinylang/AST/ASTContext.h"
 #include "tinylang/Basic/Diagnostic.h"
-#include "tinylang/Sema/Scope.h"
+#include "tinylang/Sema/ModuleLoader.h"
+#include "tinylang/Sema/SymbolTable.h"
 #include <memory>
 
 namespace tinylang {
 
 class Sema {
   friend class EnterDeclScope;
+  friend class EnterSkippedBodyScope;
   void enterScope(Decl *);
   void leaveScope();
+  void enterSkippedBodyScope(ProcedureDeclaration *Proc);
+  void leaveSkippedBodyScope();
+
+  ModuleDeclaration *loadModule(SMLoc Loc, StringRef Name);
 
   bool isOperatorForType(tok::TokenKind Op,
                          TypeDeclaration *Ty);
 
   void checkFormalAndActualParameters(
-      SMLoc Loc, const FormalParamList &Formals,
+      SMLoc Loc,
+      ArrayRef<FormalParameterDeclaration *> Formals,
       const ExprList &Actuals);
 
-  Scope *CurrentScope;
+  SourceOffset getOffset(SMLoc Loc) {
+    return SourceOffset::get(Diags.getSourceMgr(), Loc);
+  }
+  Identifier getIdentifier(StringRef Name) {
+    return Ctx.getIdentifier(Name);
+  }
+  /// Copies a list the parser built into the arena.
+  template <typename T>
+  ArrayRef<T> copyList(const std::vector<T> &List) {
+    return ASTContext::copyArray(Allocator,
+                                 ArrayRef<T>(List));
+  }
+
+  SymbolTable Symbols;
   Decl *CurrentDecl;
   DiagnosticsEngine &Diags;
+  ASTContext &Ctx;
+  // The arena of the thread this Sema runs on.
+  llvm::BumpPtrAllocator &Allocator;
+  ModuleLoader *Loader = nullptr;
+
+  // If procedure bodies were skipped, the symbols of the
+  // pervasive and module scopes with their levels are kept
+  // when the module scope is left, so that the bodies can
+  // be parsed later, possibly concurrently.
+  bool SkippedBodies = false;
+  llvm::SmallVector<std::pair<Decl *, unsigned>, 0>
+      OuterSymbols;
+  // A Sema parsing skipped bodies has the first
+  // NumReplayed outer symbols of the Sema which parsed the
+  // module in its symbol table. BodyParent is that Sema,
+  // unless it is this one.
+  const Sema *BodyParent = nullptr;
+  unsigned NumReplayed = 0;
 
   TypeDeclaration *IntegerType;
   TypeDeclaration *BooleanType;
@@ -32,21 +71,47 @@ class Sema {
   ConstantDeclaration *FalseConst;
 
 public:
-  Sema(DiagnosticsEngine &Diags)
-      : CurrentScope(nullptr), CurrentDecl(nullptr),
-        Diags(Diags) {
+  /// The AST is allocated in Ctx.
+  Sema(DiagnosticsEngine &Diags, ASTContext &Ctx)
+      : CurrentDecl(nullptr), Diags(Diags), Ctx(Ctx),
+        Allocator(Ctx.getAllocator()) {
     initialize();
   }
 
+  /// Creates a Sema for parsing the skipped bodies of the
+  /// module that Parent parsed. It shares the pervasive
+  /// declarations with Parent, and reads the symbols of
+  /// Parent's module scope, but changes nothing Parent has,
+  /// so each thread can parse bodies with a Sema of its
+  /// own.
+  Sema(DiagnosticsEngine &Diags, const Sema &Parent)
+      : CurrentDecl(nullptr), Diags(Diags), Ctx(Parent.Ctx),
+        Allocator(Parent.Ctx.createAllocator()),
+        BodyParent(&Parent), IntegerType(Parent.IntegerType),
+        BooleanType(Parent.BooleanType),
+        TrueLiteral(Parent.TrueLiteral),
+        FalseLiteral(Parent.FalseLiteral),
+        TrueConst(Parent.TrueConst),
+        FalseConst(Parent.FalseConst) {}
+
   void initialize();
 
+  /// Imported modules are loaded with L.
+  void setModuleLoader(ModuleLoader *L) { Loader = L; }
+
+  ASTContext &getASTContext() { return Ctx; }
+
+  TypeDeclaration *getIntegerType() { return IntegerType; }
+  TypeDeclaration *getBooleanType() { return BooleanType; }
+
   ModuleDeclaration *actOnModuleDeclaration(SMLoc Loc,
                                             StringRef Name);
   void actOnModuleDeclaration(ModuleDeclaration *ModDecl,
                               SMLoc Loc, StringRef Name,
                               DeclList &Decls,
                               StmtList &Stmts);
-  void actOnImport(StringRef ModuleName, IdentList &Ids);
+  void actOnImport(SMLoc Loc, StringRef ModuleName,
+                   IdentList &Ids);
   void actOnConstantDeclaration(DeclList &Decls, SMLoc Loc,
                                 StringRef Name, Expr *E);
   void actOnAliasTypeDeclaration(DeclList &Decls, SMLoc Loc,
@@ -76,6 +141,12 @@ public:
   void actOnProcedureDeclaration(
       ProcedureDeclaration *ProcDecl, SMLoc Loc,
       StringRef Name, DeclList &Decls, StmtList &Stmts);
+  void actOnSkippedProcedureBody(
+      ProcedureDeclaration *ProcDecl, SMLoc Loc,
+      StringRef Name, SMLoc BodyLoc);
+  void actOnSkippedBodyParsed(ProcedureDeclaration *ProcDecl,
+                              DeclList &Decls,
+                              StmtList &Stmts);
   void actOnAssignment(StmtList &Stmts, SMLoc Loc, Expr *D,
                        Expr *E);
   void actOnProcCall(StmtList &Stmts, SMLoc Loc, Decl *D,
@@ -117,5 +188,22 @@ public:
   }
   ~EnterDeclScope() { Semantics.leaveScope(); }
 };
+
+/// Recreates the scopes that a skipped procedure body was
+/// in: the module scope as it was when the procedure was
+/// declared, and the procedure with its formal parameters.
+class EnterSkippedBodyScope {
+  Sema &Semantics;
+
+public:
+  EnterSkippedBodyScope(Sema &Semantics,
+                        ProcedureDeclaration *Proc)
+      : Semantics(Semantics) {
+    Semantics.enterSkippedBodyScope(Proc);
+  }
+  ~EnterSkippedBodyScope() {
+    Semantics.leaveSkippedBodyScope();
+  }
+};
 } // namespace tinylang
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef TINYLANG_SEMA_SYMBOLTABLE_H
+#define TINYLANG_SEMA_SYMBOLTABLE_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <vector>
+
+namespace tinylang {
+
+class Decl;
+
+/// The symbols of all open scopes. Each name maps to the
+/// stack of its declarations, innermost scope on top, so a
+/// lookup is one hash probe however deep the nesting.
+/// Leaving a scope pops the declarations it inserted,
+/// which an undo log records. Entering and leaving scopes
+/// does not allocate once the table has grown.
+class SymbolTable {
+  struct Binding {
+    Decl *D;
+    unsigned Level;
+  };
+  using SymbolMap =
+      StringMap<llvm::SmallVector<Binding, 1>>;
+
+  SymbolMap Symbols;
+  // The bindings of the open scopes in the order they were
+  // made.
+  std::vector<SymbolMap::MapEntryTy *> UndoLog;
+  // Size of the undo log when each open scope was entered.
+  llvm::SmallVector<unsigned, 8> ScopeStarts;
+
+public:
+  void enterScope() { ScopeStarts.push_back(UndoLog.size()); }
+  void leaveScope();
+
+  /// Inserts D into the innermost scope. Returns false if
+  /// the scope has a declaration with this name already.
+  bool insert(Decl *D);
+
+  Decl *lookup(StringRef Name) const {
+    auto I = Symbols.find(Name);
+    if (I == Symbols.end() || I->second.empty())
+      return nullptr;
+    return I->second.back().D;
+  }
+
+  /// Nesting depth of the innermost scope; symbols
+  /// inserted before any scope is entered are at level 0.
+  unsigned getLevel() const { return ScopeStarts.size(); }
+
+  /// Number of symbols in the scopes enclosing the
+  /// innermost one.
+  unsigned getNumOuterSymbols() const {
+    return ScopeStarts.empty() ? 0 : ScopeStarts.back();
+  }
+
+  /// Appends the symbols of all open scopes with their
+  /// levels, in the order they were inserted.
+  void getSymbols(
+      llvm::SmallVectorImpl<std::pair<Decl *, unsigned>> &Out)
+      const;
+};
+} // namespace tinylang
+#endif
@@ -0,0 +1,44 @@
+#ifndef TINYLANG_SERIALIZATION_BUILDRECORD_H
+#define TINYLANG_SERIALIZATION_BUILDRECORD_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tinylang {
+
+/// Extension of build records. The record of output X is
+/// X.tlb.
+constexpr const char *BuildRecordExtension = ".tlb";
+
+/// What the output of a module was compiled from. As long
+/// as none of it changes, the module need not be compiled
+/// again. Only interfaces are recorded for imports, so
+/// changing the body of an imported module does not make
+/// importers stale.
+struct BuildRecord {
+  /// Hash of the source file.
+  uint64_t SourceHash = 0;
+  /// Hash of the compiler version and options.
+  uint64_t OptionsHash = 0;
+  /// Name of the module, and hash of the interface that
+  /// was written for it.
+  std::string ModuleName;
+  uint64_t InterfaceHash = 0;
+  /// Names and interface hashes of the imported modules.
+  std::vector<std::pair<std::string, uint64_t>> Imports;
+
+  /// Reads the record at Path. Nothing if there is none or
+  /// if it is malformed.
+  static std::optional<BuildRecord> read(StringRef Path);
+
+  /// Writes the record to Path. Returns false on error.
+  bool write(StringRef Path) const;
+};
+
+} // namespace tinylang
+#endif
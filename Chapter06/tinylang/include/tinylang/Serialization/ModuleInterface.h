@@ -0,0 +1,79 @@
+#ifndef TINYLANG_SERIALIZATION_MODULEINTERFACE_H
+#define TINYLANG_SERIALIZATION_MODULEINTERFACE_H
+
+#include "tinylang/AST/AST.h"
+#include "tinylang/AST/ASTContext.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Sema/ModuleLoader.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+
+class ModuleInterfaceReader;
+class Sema;
+
+/// Extension of module interface files. The interface of
+/// module X is read from X.tli.
+constexpr const char *ModuleInterfaceExtension = ".tli";
+
+/// Writes the interface of Mod to OS: its declarations,
+/// with their types and constant values, in a compact
+/// binary form. Constants whose value can not be computed,
+/// and declarations that depend on them, are left out.
+void writeModuleInterface(ModuleDeclaration *Mod,
+                          raw_ostream &OS);
+
+/// Returns the path of the interface of module Name in the
+/// first directory of SearchPath that has it, or an empty
+/// string.
+std::string
+findModuleInterface(llvm::ArrayRef<std::string> SearchPath,
+                    StringRef Name);
+
+/// Hash of the contents of an interface file. Equal
+/// interfaces have equal hashes.
+uint64_t hashModuleInterface(StringRef Contents);
+
+/// Loads module interfaces from the first directory of a
+/// search path that has them. The files are mapped into
+/// memory, and a declaration is only created when an
+/// importer looks it up. Each module is loaded once, so
+/// that all importers see the same declarations.
+class ModuleInterfaceLoader : public ModuleLoader {
+  DiagnosticsEngine &Diags;
+  ASTContext &Ctx;
+  TypeDeclaration *IntegerType;
+  TypeDeclaration *BooleanType;
+  std::vector<std::string> SearchPath;
+
+  // Loaded modules, or nullptr if loading failed.
+  StringMap<std::unique_ptr<ModuleInterfaceReader>> Modules;
+  // Modules being loaded, to detect cyclic imports.
+  llvm::StringSet<> Loading;
+
+public:
+  /// Declarations of loaded modules use the pervasive types
+  /// of Actions, and are allocated in its ASTContext.
+  ModuleInterfaceLoader(DiagnosticsEngine &Diags,
+                        Sema &Actions,
+                        llvm::ArrayRef<std::string> SearchPath);
+  ~ModuleInterfaceLoader();
+
+  ModuleDeclaration *loadModule(SMLoc Loc,
+                                StringRef Name) override;
+
+  /// Returns the names and hashes of the interfaces loaded
+  /// so far, including those only loaded for the types
+  /// other interfaces use.
+  std::vector<std::pair<std::string, uint64_t>>
+  getLoadedInterfaces() const;
+};
+
+} // namespace tinylang
+#endif
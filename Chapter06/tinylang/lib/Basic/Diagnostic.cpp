@@ -1,4 +1,5 @@
 #include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/DiagnosticPrinter.h"
 
 using namespace tinylang;
 
@@ -11,8 +12,27 @@ SourceMgr::DiagKind DiagnosticKind[] = {
 #define DIAG(ID, Level, Msg) SourceMgr::DK_##Level,
 #include "tinylang/Basic/Diagnostic.def"
 };
+const char *DiagnosticName[] = {
+#define DIAG(ID, Level, Msg) #ID,
+#include "tinylang/Basic/Diagnostic.def"
+};
 } // namespace
 
+DiagnosticConsumer::~DiagnosticConsumer() = default;
+
+void DiagnosticBuffer::flushTo(DiagnosticsEngine &Diags) {
+  for (BufferedDiagnostic &D : Buffered)
+    Diags.emit(D.Loc, D.ID, [&D] { return D.Msg; });
+  Buffered.clear();
+}
+
+DiagnosticsEngine::DiagnosticsEngine(SourceMgr &SrcMgr)
+    : SrcMgr(SrcMgr) {
+  OwnedClient =
+      std::make_unique<TextDiagnosticPrinter>(llvm::errs());
+  Client = OwnedClient.get();
+}
+
 const char *
 DiagnosticsEngine::getDiagnosticText(unsigned DiagID) {
   return DiagnosticText[DiagID];
@@ -21,4 +41,37 @@ DiagnosticsEngine::getDiagnosticText(unsigned DiagID) {
 SourceMgr::DiagKind
 DiagnosticsEngine::getDiagnosticKind(unsigned DiagID) {
   return DiagnosticKind[DiagID];
-}
\ No newline at end of file
+}
+
+StringRef
+DiagnosticsEngine::getDiagnosticName(unsigned DiagID) {
+  return DiagnosticName[DiagID];
+}
+
+void DiagnosticsEngine::emit(
+    SMLoc Loc, unsigned DiagID,
+    llvm::function_ref<std::string()> Format) {
+  SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
+  if (Kind == SourceMgr::DK_Note) {
+    if (LastDiagnosticDropped)
+      return;
+  } else {
+    LastDiagnosticDropped = FatalErrorOccurred;
+    if (FatalErrorOccurred)
+      return;
+    if (Kind == SourceMgr::DK_Error && ErrorLimit &&
+        NumErrors >= ErrorLimit) {
+      FatalErrorOccurred = true;
+      LastDiagnosticDropped = true;
+      DiagID = diag::err_too_many_errors;
+      Client->handleDiagnostic(Diagnostic(
+          SrcMgr, SMLoc(), DiagID, Kind,
+          [DiagID] { return getDiagnosticText(DiagID); }));
+      ++NumErrors;
+      return;
+    }
+  }
+  NumErrors += (Kind == SourceMgr::DK_Error);
+  Client->handleDiagnostic(
+      Diagnostic(SrcMgr, Loc, DiagID, Kind, Format));
+}
@@ -0,0 +1,137 @@
+#include "tinylang/Basic/DiagnosticPrinter.h"
+#include "tinylang/Basic/Version.h"
+
+using namespace tinylang;
+
+namespace {
+// Where a diagnostic points to. Line and column are 0 for
+// diagnostics without a location.
+struct Position {
+  StringRef File;
+  unsigned Line = 0;
+  unsigned Column = 0;
+};
+
+Position getPosition(const Diagnostic &D) {
+  Position P;
+  const SourceMgr &SrcMgr = D.getSourceMgr();
+  SMLoc Loc = D.getLocation();
+  if (!Loc.isValid())
+    return P;
+  if (unsigned ID = SrcMgr.FindBufferContainingLoc(Loc)) {
+    P.File =
+        SrcMgr.getMemoryBuffer(ID)->getBufferIdentifier();
+    std::tie(P.Line, P.Column) =
+        SrcMgr.getLineAndColumn(Loc, ID);
+  }
+  return P;
+}
+
+StringRef getLevel(SourceMgr::DiagKind Kind) {
+  switch (Kind) {
+  case SourceMgr::DK_Error:
+    return "error";
+  case SourceMgr::DK_Warning:
+    return "warning";
+  case SourceMgr::DK_Remark:
+    return "remark";
+  case SourceMgr::DK_Note:
+    return "note";
+  }
+  llvm_unreachable("Unknown diagnostic kind");
+}
+} // namespace
+
+void TextDiagnosticPrinter::handleDiagnostic(
+    const Diagnostic &D) {
+  // SourceMgr names the file of a missing location
+  // <unknown>.
+  if (!D.getLocation().isValid()) {
+    llvm::SMDiagnostic(StringRef(), D.getKind(),
+                       D.getMessage())
+        .print(nullptr, OS);
+    return;
+  }
+  D.getSourceMgr().PrintMessage(
+      OS, D.getLocation(), D.getKind(), D.getMessage());
+}
+
+void JSONDiagnosticPrinter::handleDiagnostic(
+    const Diagnostic &D) {
+  Position P = getPosition(D);
+  llvm::json::OStream J(OS);
+  J.object([&] {
+    if (!P.File.empty()) {
+      J.attribute("file", P.File);
+      J.attribute("line", P.Line);
+      J.attribute("column", P.Column);
+    }
+    J.attribute("level", getLevel(D.getKind()));
+    J.attribute("id", DiagnosticsEngine::getDiagnosticName(
+                          D.getID()));
+    J.attribute("message", D.getMessage());
+  });
+  OS << '\n';
+}
+
+void SARIFDiagnosticPrinter::handleDiagnostic(
+    const Diagnostic &D) {
+  Position P = getPosition(D);
+  // SARIF knows no remarks.
+  StringRef Level = D.getKind() == SourceMgr::DK_Remark
+                        ? "note"
+                        : getLevel(D.getKind());
+  llvm::json::Object Result{
+      {"ruleId",
+       DiagnosticsEngine::getDiagnosticName(D.getID())},
+      {"level", Level},
+      {"message", llvm::json::Object{
+                      {"text", D.getMessage()}}}};
+  if (!P.File.empty()) {
+    llvm::json::Object Region{{"startLine", P.Line},
+                              {"startColumn", P.Column}};
+    // The log is printed after the SourceMgr is gone, so
+    // the file name is copied.
+    llvm::json::Object Location{
+        {"artifactLocation",
+         llvm::json::Object{{"uri", P.File.str()}}},
+        {"region", std::move(Region)}};
+    Result["locations"] = llvm::json::Array{
+        llvm::json::Object{{"physicalLocation",
+                            std::move(Location)}}};
+  }
+  Results.push_back(std::move(Result));
+}
+
+void SARIFDiagnosticPrinter::finish() {
+  llvm::json::Object Driver{
+      {"name", "tinylang"},
+      {"version", getTinylangVersion()}};
+  llvm::json::Object Log{
+      {"$schema",
+       "https://json.schemastore.org/sarif-2.1.0.json"},
+      {"version", "2.1.0"},
+      {"runs",
+       llvm::json::Array{llvm::json::Object{
+           {"tool", llvm::json::Object{
+                        {"driver", std::move(Driver)}}},
+           {"results", std::move(Results)}}}}};
+  OS << llvm::formatv("{0:2}",
+                      llvm::json::Value(std::move(Log)))
+     << '\n';
+  Results.clear();
+}
+
+std::unique_ptr<DiagnosticConsumer>
+tinylang::createDiagnosticPrinter(DiagnosticFormat Format,
+                                  raw_ostream &OS) {
+  switch (Format) {
+  case DiagnosticFormat::Text:
+    return std::make_unique<TextDiagnosticPrinter>(OS);
+  case DiagnosticFormat::JSON:
+    return std::make_unique<JSONDiagnosticPrinter>(OS);
+  case DiagnosticFormat::SARIF:
+    return std::make_unique<SARIFDiagnosticPrinter>(OS);
+  }
+  llvm_unreachable("Unknown diagnostic format");
+}
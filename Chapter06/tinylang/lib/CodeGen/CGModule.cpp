@@ -86,7 +86,17 @@ std::string CGModule::mangleName(Decl *D) {
 }
 
 llvm::GlobalObject *CGModule::getGlobal(Decl *D) {
-  return Globals[D];
+  llvm::GlobalObject *&Global = Globals[D];
+  if (!Global) {
+    // A variable of an imported module is defined there.
+    auto *Var = llvm::cast<VariableDeclaration>(D);
+    Global = new llvm::GlobalVariable(
+        *M, convertType(Var->getType()),
+        /*isConstant=*/false,
+        llvm::GlobalValue::ExternalLinkage, nullptr,
+        mangleName(Var));
+  }
+  return Global;
 }
 
 void CGModule::run(ModuleDeclaration *Mod) {
@@ -94,11 +104,14 @@ void CGModule::run(ModuleDeclaration *Mod) {
   for (auto *Decl : Mod->getDecls()) {
     if (auto *Var =
             llvm::dyn_cast<VariableDeclaration>(Decl)) {
-      // Create global variables
+      // Create global variables. Importing modules can
+      // access them, and they start out zeroed.
+      llvm::Type *Ty = convertType(Var->getType());
       llvm::GlobalVariable *V = new llvm::GlobalVariable(
-          *M, convertType(Var->getType()),
+          *M, Ty,
           /*isConstant=*/false,
-          llvm::GlobalValue::PrivateLinkage, nullptr,
+          llvm::GlobalValue::ExternalLinkage,
+          llvm::Constant::getNullValue(Ty),
           mangleName(Var));
       Globals[Var] = V;
     } else if (auto *Proc =
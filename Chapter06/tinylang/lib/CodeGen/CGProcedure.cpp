@@ -113,8 +113,8 @@ void CGProcedure::writeVariable(llvm::BasicBlock *BB,
   if (auto *V = llvm::dyn_cast<VariableDeclaration>(D)) {
     if (V->getEnclosingDecl() == Proc)
       writeLocalVariable(BB, D, Val);
-    else if (V->getEnclosingDecl() ==
-             CGM.getModuleDeclaration()) {
+    else if (llvm::isa<ModuleDeclaration>(
+                 V->getEnclosingDecl())) {
       Builder.CreateStore(Val, CGM.getGlobal(D));
     } else
       llvm::report_fatal_error(
@@ -136,8 +136,8 @@ llvm::Value *CGProcedure::readVariable(llvm::BasicBlock *BB,
   if (auto *V = llvm::dyn_cast<VariableDeclaration>(D)) {
     if (V->getEnclosingDecl() == Proc)
       return readLocalVariable(BB, D);
-    else if (V->getEnclosingDecl() ==
-             CGM.getModuleDeclaration()) {
+    else if (llvm::isa<ModuleDeclaration>(
+                 V->getEnclosingDecl())) {
       auto *Global = CGM.getGlobal(D);
       if (!LoadVal)
         return Global;
@@ -221,7 +221,7 @@ CGProcedure::emitInfixExpr(InfixExpression *E) {
   llvm::Value *Left = emitExpr(E->getLeft());
   llvm::Value *Right = emitExpr(E->getRight());
   llvm::Value *Result = nullptr;
-  switch (E->getOperatorInfo().getKind()) {
+  switch (E->getOperatorKind()) {
   case tok::plus:
     Result = Builder.CreateNSWAdd(Left, Right);
     break;
@@ -273,7 +273,7 @@ CGProcedure::emitInfixExpr(InfixExpression *E) {
 llvm::Value *
 CGProcedure::emitPrefixExpr(PrefixExpression *E) {
   llvm::Value *Result = emitExpr(E->getExpr());
-  switch (E->getOperatorInfo().getKind()) {
+  switch (E->getOperatorKind()) {
   case tok::plus:
     // Identity - nothing to do.
     break;
@@ -300,7 +300,7 @@ llvm::Value *CGProcedure::emitExpr(Expr *E) {
     llvm::Value *Val = readVariable(Curr, Decl);
     // With more languages features in place, here you
     // need to add array and record support.
-    auto &Selectors = Var->getSelectors();
+    auto Selectors = Var->getSelectors();
     for (auto I = Selectors.begin(), E = Selectors.end();
          I != E;
          /* no increment */) {
@@ -364,7 +364,7 @@ llvm::Value *CGProcedure::emitExpr(Expr *E) {
 void CGProcedure::emitStmt(AssignmentStatement *Stmt) {
   auto *Val = emitExpr(Stmt->getExpr());
   Designator *Desig = Stmt->getVar();
-  auto &Selectors = Desig->getSelectors();
+  auto Selectors = Desig->getSelectors();
   if (Selectors.empty())
     writeVariable(Curr, Desig->getDecl(), Val);
   else {
@@ -478,7 +478,7 @@ void CGProcedure::emitStmt(ReturnStatement *Stmt) {
   }
 }
 
-void CGProcedure::emit(const StmtList &Stmts) {
+void CGProcedure::emit(ArrayRef<Stmt *> Stmts) {
   for (auto *S : Stmts) {
     if (auto *Stmt = llvm::dyn_cast<AssignmentStatement>(S))
       emitStmt(Stmt);
@@ -528,7 +528,6 @@ void CGProcedure::run(ProcedureDeclaration *Proc) {
     }
   }
 
-  auto Block = Proc->getStmts();
   emit(Proc->getStmts());
   if (!Curr->getTerminator()) {
     Builder.CreateRetVoid();
@@ -0,0 +1,277 @@
+#include "tinylang/Daemon/Protocol.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace tinylang;
+using namespace tinylang::daemon;
+
+std::string daemon::getSocketPath() {
+  if (auto Path = llvm::sys::Process::GetEnv(SocketEnvVar))
+    return *Path;
+  llvm::SmallString<128> Path;
+  llvm::sys::path::system_temp_directory(
+      /*ErasedOnReboot=*/true, Path);
+#ifdef LLVM_ON_UNIX
+  // In a directory only the user can enter, so that no one
+  // else can reach or replace the socket.
+  llvm::sys::path::append(
+      Path, "tinylang-" + llvm::Twine(getuid()));
+  ::mkdir(Path.c_str(), 0700);
+  llvm::sys::path::append(Path, "daemon.socket");
+#else
+  llvm::sys::path::append(Path, "tinylang.socket");
+#endif
+  return std::string(Path);
+}
+
+#ifdef LLVM_ON_UNIX
+namespace {
+// Fills Addr with Path. Returns false if Path is too long.
+bool getAddress(StringRef Path, sockaddr_un &Addr) {
+  std::memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  if (Path.size() >= sizeof(Addr.sun_path))
+    return false;
+  std::memcpy(Addr.sun_path, Path.data(), Path.size());
+  return true;
+}
+
+int createSocket() {
+  int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD < 0)
+    return -1;
+  ::fcntl(FD, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+  int On = 1;
+  ::setsockopt(FD, SOL_SOCKET, SO_NOSIGPIPE, &On,
+               sizeof(On));
+#endif
+  return FD;
+}
+
+// Whether the other end of socket FD runs as the current
+// user. The daemon compiles with the rights of its user, and
+// the client trusts the output of the daemon.
+bool isPeerTrusted(int FD) {
+#ifdef SO_PEERCRED
+  struct ucred Cred;
+  socklen_t Len = sizeof(Cred);
+  if (::getsockopt(FD, SOL_SOCKET, SO_PEERCRED, &Cred,
+                   &Len) < 0)
+    return false;
+  return Cred.uid == ::getuid();
+#else
+  uid_t UID;
+  gid_t GID;
+  if (::getpeereid(FD, &UID, &GID) < 0)
+    return false;
+  return UID == ::getuid();
+#endif
+}
+
+// Whether the directory of socket Path belongs to the current
+// user and only they can write to it.
+bool isDirectoryPrivate(StringRef Path) {
+  llvm::SmallString<128> Dir(
+      llvm::sys::path::parent_path(Path));
+  if (Dir.empty())
+    Dir = ".";
+  struct stat St;
+  if (::lstat(Dir.c_str(), &St) < 0 || !S_ISDIR(St.st_mode))
+    return false;
+  return St.st_uid == ::getuid() &&
+         !(St.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+bool sendAll(int FD, const char *Data, size_t Size) {
+#ifdef MSG_NOSIGNAL
+  // A client which went away must not kill the daemon.
+  const int Flags = MSG_NOSIGNAL;
+#else
+  const int Flags = 0;
+#endif
+  while (Size) {
+    ssize_t N = ::send(FD, Data, Size, Flags);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Data += N;
+    Size -= N;
+  }
+  return true;
+}
+
+bool receiveAll(int FD, char *Data, size_t Size) {
+  while (Size) {
+    ssize_t N = ::recv(FD, Data, Size, 0);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Data += N;
+    Size -= N;
+  }
+  return true;
+}
+
+bool receive32(int FD, uint32_t &V) {
+  char Bytes[4];
+  if (!receiveAll(FD, Bytes, 4))
+    return false;
+  V = llvm::support::endian::read32le(Bytes);
+  return true;
+}
+} // namespace
+
+int daemon::listenAt(StringRef Path, std::string &Error) {
+  sockaddr_un Addr;
+  if (!getAddress(Path, Addr)) {
+    Error = "socket path is too long";
+    return -1;
+  }
+  // Others could replace the socket in a shared directory.
+  if (!isDirectoryPrivate(Path)) {
+    Error = "the directory of the socket must belong to "
+            "the user and not be writable by others";
+    return -1;
+  }
+  int FD = createSocket();
+  if (FD < 0) {
+    Error = std::strerror(errno);
+    return -1;
+  }
+  auto *SA = reinterpret_cast<sockaddr *>(&Addr);
+  int Result = ::bind(FD, SA, sizeof(Addr));
+  if (Result < 0 && errno == EADDRINUSE) {
+    int Other = connectTo(Path);
+    if (Other >= 0) {
+      closeSocket(Other);
+      closeSocket(FD);
+      Error = "a daemon is already listening";
+      return -1;
+    }
+    ::unlink(Addr.sun_path);
+    Result = ::bind(FD, SA, sizeof(Addr));
+  }
+  if (Result < 0 || ::listen(FD, SOMAXCONN) < 0) {
+    Error = std::strerror(errno);
+    closeSocket(FD);
+    return -1;
+  }
+  return FD;
+}
+
+int daemon::connectTo(StringRef Path) {
+  sockaddr_un Addr;
+  if (!getAddress(Path, Addr))
+    return -1;
+  int FD = createSocket();
+  if (FD < 0)
+    return -1;
+  if (::connect(FD, reinterpret_cast<sockaddr *>(&Addr),
+                sizeof(Addr)) < 0 ||
+      !isPeerTrusted(FD)) {
+    closeSocket(FD);
+    return -1;
+  }
+  return FD;
+}
+
+int daemon::acceptClient(int FD) {
+  for (;;) {
+    int Client = ::accept(FD, nullptr, nullptr);
+    if (Client < 0 && errno == EINTR)
+      continue;
+    if (Client < 0)
+      return Client;
+    if (!isPeerTrusted(Client)) {
+      closeSocket(Client);
+      continue;
+    }
+    ::fcntl(Client, F_SETFD, FD_CLOEXEC);
+    // A client which sends nothing must not hold a thread
+    // of the daemon.
+    timeval Timeout = {RequestTimeoutSeconds, 0};
+    ::setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout,
+                 sizeof(Timeout));
+    return Client;
+  }
+}
+
+void daemon::closeSocket(int FD) { ::close(FD); }
+
+bool daemon::sendStrings(
+    int FD, llvm::ArrayRef<std::string> Strings) {
+  std::string Buf;
+  auto Append32 = [&Buf](uint32_t V) {
+    char Bytes[4];
+    llvm::support::endian::write32le(Bytes, V);
+    Buf.append(Bytes, 4);
+  };
+  Append32(Strings.size());
+  for (const std::string &S : Strings) {
+    Append32(S.size());
+    Buf += S;
+  }
+  return sendAll(FD, Buf.data(), Buf.size());
+}
+
+bool daemon::receiveStrings(
+    int FD, std::vector<std::string> &Strings) {
+  // Bounds against garbage from something that is not a
+  // client.
+  const uint32_t MaxStrings = 1 << 16;
+  const uint32_t MaxLength = 1 << 30;
+  uint32_t Count;
+  if (!receive32(FD, Count) || Count > MaxStrings)
+    return false;
+  Strings.clear();
+  Strings.reserve(Count);
+  for (uint32_t I = 0; I != Count; ++I) {
+    uint32_t Length;
+    if (!receive32(FD, Length) || Length > MaxLength)
+      return false;
+    std::string &S = Strings.emplace_back(Length, '\0');
+    if (!receiveAll(FD, S.data(), Length))
+      return false;
+  }
+  return true;
+}
+#else
+int daemon::listenAt(StringRef Path, std::string &Error) {
+  Error = "the daemon needs Unix domain sockets";
+  return -1;
+}
+
+int daemon::connectTo(StringRef Path) { return -1; }
+
+int daemon::acceptClient(int FD) { return -1; }
+
+void daemon::closeSocket(int FD) {}
+
+bool daemon::sendStrings(
+    int FD, llvm::ArrayRef<std::string> Strings) {
+  return false;
+}
+
+bool daemon::receiveStrings(
+    int FD, std::vector<std::string> &Strings) {
+  return false;
+}
+#endif
@@ -56,7 +56,9 @@ void Lexer::next(Token &Result) {
   while (*CurPtr && charinfo::isWhitespace(*CurPtr)) {
     ++CurPtr;
   }
-  if (!*CurPtr) {
+  // After too many errors, the rest of the input is not
+  // worth looking at.
+  if (!*CurPtr || Diags.hasFatalErrorOccurred()) {
     Result.setKind(tok::eof);
     return;
   }
@@ -149,7 +151,7 @@ void Lexer::number(Token &Result) {
     ++End;
     break;
   default: /* decimal number */
-    if (IsHex)
+    if (IsHex && ReportErrors)
       Diags.report(getLoc(),
                    diag::err_hex_digit_in_decimal);
     Kind = tok::integer_literal;
@@ -164,7 +166,8 @@ void Lexer::string(Token &Result) {
   while (*End && *End != *Start &&
          !charinfo::isVerticalWhitespace(*End))
     ++End;
-  if (charinfo::isVerticalWhitespace(*End)) {
+  if (charinfo::isVerticalWhitespace(*End) &&
+      ReportErrors) {
     Diags.report(getLoc(),
                  diag::err_unterminated_char_or_string);
   }
@@ -187,7 +190,7 @@ void Lexer::comment() {
     } else
       ++End;
   }
-  if (!*End) {
+  if (!*End && ReportErrors) {
     Diags.report(getLoc(),
                  diag::err_unterminated_block_comment);
   }
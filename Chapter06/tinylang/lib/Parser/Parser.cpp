@@ -1,5 +1,8 @@
 #include "tinylang/Parser/Parser.h"
 #include "tinylang/Basic/TokenKinds.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <memory>
 
 using namespace tinylang;
 
@@ -61,11 +64,13 @@ bool Parser::parseImport() {
                      tok::kw_TYPE, tok::kw_VAR);
   };
   IdentList Ids;
+  SMLoc ModuleLoc = Tok.getLocation();
   StringRef ModuleName;
   if (Tok.is(tok::kw_FROM)) {
     advance();
     if (expect(tok::identifier))
       return _errorhandler();
+    ModuleLoc = Tok.getLocation();
     ModuleName = Tok.getIdentifier();
     advance();
   }
@@ -75,7 +80,7 @@ bool Parser::parseImport() {
     return _errorhandler();
   if (expect(tok::semi))
     return _errorhandler();
-  Actions.actOnImport(ModuleName, Ids);
+  Actions.actOnImport(ModuleLoc, ModuleName, Ids);
   advance();
   return false;
 }
@@ -298,19 +303,144 @@ bool Parser::parseProcedureDeclaration(
   DeclList Decls;
   StmtList Stmts;
   advance();
-  if (parseBlock(Decls, Stmts))
-    return _errorhandler();
-  if (expect(tok::identifier))
-    return _errorhandler();
-  Actions.actOnProcedureDeclaration(
-      D, Tok.getLocation(), Tok.getIdentifier(), Decls,
-      Stmts);
+  if (SkipBodies &&
+      isa<ModuleDeclaration>(D->getEnclosingDecl())) {
+    SMLoc BodyLoc = Tok.getLocation();
+    if (skipProcedureBody())
+      return _errorhandler();
+    advance();
+    if (expect(tok::identifier))
+      return _errorhandler();
+    Actions.actOnSkippedProcedureBody(
+        D, Tok.getLocation(), Tok.getIdentifier(),
+        BodyLoc);
+  } else {
+    if (parseBlock(Decls, Stmts))
+      return _errorhandler();
+    if (expect(tok::identifier))
+      return _errorhandler();
+    Actions.actOnProcedureDeclaration(
+        D, Tok.getLocation(), Tok.getIdentifier(), Decls,
+        Stmts);
+  }
 
   ParentDecls.push_back(D);
   advance();
   return false;
 }
 
+// Skips the declarations and statements of a procedure
+// up to the END that closes it. Without parsing, the END
+// is found by counting the constructs that END closes.
+// Lexical errors are reported when the body is parsed.
+bool Parser::skipProcedureBody() {
+  unsigned Depth = 1;
+  Lex.setReportErrors(false);
+  while (true) {
+    switch (Tok.getKind()) {
+    case tok::kw_IF:
+    case tok::kw_PROCEDURE:
+    case tok::kw_RECORD:
+    case tok::kw_WHILE:
+      ++Depth;
+      break;
+    case tok::kw_END:
+      if (--Depth == 0) {
+        Lex.setReportErrors(true);
+        return false;
+      }
+      break;
+    case tok::eof:
+      Lex.setReportErrors(true);
+      return expect(tok::kw_END);
+    default:
+      break;
+    }
+    advance();
+  }
+}
+
+bool Parser::parseSkippedBody(ProcedureDeclaration *D) {
+  assert(D->hasSkippedBody() && "Body is not skipped");
+  Lex.restore(D->getBodyLoc().getLoc(
+      getDiagnostics().getSourceMgr()));
+  advance();
+  EnterSkippedBodyScope S(Actions, D);
+  DeclList Decls;
+  StmtList Stmts;
+  bool Failed = parseBlock(Decls, Stmts);
+  Actions.actOnSkippedBodyParsed(D, Decls, Stmts);
+  return Failed;
+}
+
+bool Parser::parseSkippedBodies(ModuleDeclaration *Mod) {
+  bool Failed = false;
+  for (Decl *D : Mod->getDecls())
+    if (auto *Proc = dyn_cast<ProcedureDeclaration>(D))
+      if (Proc->hasSkippedBody())
+        Failed |= parseSkippedBody(Proc);
+  return Failed;
+}
+
+bool Parser::parseSkippedBodies(ModuleDeclaration *Mod,
+                                llvm::ThreadPool &Pool) {
+  // Nothing more is reported after too many errors.
+  if (getDiagnostics().hasFatalErrorOccurred())
+    return true;
+  std::vector<ProcedureDeclaration *> Procs;
+  for (Decl *D : Mod->getDecls())
+    if (auto *Proc = dyn_cast<ProcedureDeclaration>(D))
+      if (Proc->hasSkippedBody())
+        Procs.push_back(Proc);
+  if (Procs.empty())
+    return false;
+
+  // Bodies are handed out in runs of consecutive
+  // procedures: a few runs per thread balance the load,
+  // while each run needs only one lexer and Sema.
+  size_t NumRuns = std::min<size_t>(
+      Procs.size(), 4 * Pool.getThreadCount());
+  std::vector<DiagnosticBuffer> RunBuffers(NumRuns);
+  std::vector<std::unique_ptr<DiagnosticsEngine>> RunDiags(
+      NumRuns);
+  std::vector<char> RunFailed(NumRuns);
+  DiagnosticsEngine &Diags = getDiagnostics();
+  // A run stops early once it alone would exceed the error
+  // limit; its errors are counted again when flushed.
+  unsigned Limit = Diags.getErrorLimit();
+  if (Limit)
+    Limit = std::max(Limit - Diags.numErrors(), 1u);
+  for (size_t R = 0; R != NumRuns; ++R) {
+    RunDiags[R] = std::make_unique<DiagnosticsEngine>(
+        Diags.getSourceMgr(), RunBuffers[R]);
+    RunDiags[R]->setErrorLimit(Limit);
+    Pool.async([&, R] {
+      size_t Begin = Procs.size() * R / NumRuns;
+      size_t End = Procs.size() * (R + 1) / NumRuns;
+      Lexer RunLex(Diags.getSourceMgr(), *RunDiags[R]);
+      Sema RunActions(*RunDiags[R], Actions);
+      // The parser reads a first token, which belongs to
+      // the main parser.
+      RunLex.setReportErrors(false);
+      Parser RunParser(RunLex, RunActions);
+      RunLex.setReportErrors(true);
+      bool Failed = false;
+      for (size_t I = Begin; I != End; ++I)
+        Failed |= RunParser.parseSkippedBody(Procs[I]);
+      RunFailed[R] = Failed;
+    });
+  }
+  Pool.wait();
+
+  // The runs cover the bodies in source order.
+  bool Failed = false;
+  for (size_t R = 0; R != NumRuns; ++R) {
+    RunBuffers[R].flushTo(Diags);
+    Failed |= RunFailed[R];
+  }
+  return Failed;
+}
+
 bool Parser::parseFormalParameters(
     FormalParamList &Params, Decl *&RetType) {
   auto _errorhandler = [this] {
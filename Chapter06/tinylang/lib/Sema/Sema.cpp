@@ -5,18 +5,48 @@
 using namespace tinylang;
 
 void Sema::enterScope(Decl *D) {
-  CurrentScope = new Scope(CurrentScope);
+  Symbols.enterScope();
   CurrentDecl = D;
 }
 
 void Sema::leaveScope() {
-  assert(CurrentScope && "Can't leave non-existing scope");
-  Scope *Parent = CurrentScope->getParent();
-  delete CurrentScope;
-  CurrentScope = Parent;
+  if (SkippedBodies && isa<ModuleDeclaration>(CurrentDecl))
+    Symbols.getSymbols(OuterSymbols);
+  Symbols.leaveScope();
   CurrentDecl = CurrentDecl->getEnclosingDecl();
 }
 
+// The symbols visible in the body are inserted again, into
+// the scopes they were declared in. Bodies are usually
+// parsed in source order, seeing more symbols each time,
+// so the symbols of earlier bodies are kept.
+void Sema::enterSkippedBodyScope(
+    ProcedureDeclaration *Proc) {
+  const Sema &Parent = BodyParent ? *BodyParent : *this;
+  unsigned NumVisible = Proc->getNumVisibleDecls();
+  assert(NumVisible <= Parent.OuterSymbols.size() &&
+         "Module scope not left");
+  if (NumReplayed == 0 || NumVisible < NumReplayed) {
+    Symbols = SymbolTable();
+    NumReplayed = 0;
+  }
+  for (; NumReplayed != NumVisible; ++NumReplayed) {
+    auto [D, Level] = Parent.OuterSymbols[NumReplayed];
+    while (Symbols.getLevel() < Level)
+      Symbols.enterScope();
+    Symbols.insert(D);
+  }
+  enterScope(Proc);
+  for (FormalParameterDeclaration *FP :
+       Proc->getFormalParams())
+    Symbols.insert(FP);
+}
+
+void Sema::leaveSkippedBodyScope() {
+  Symbols.leaveScope();
+  CurrentDecl = nullptr;
+}
+
 bool Sema::isOperatorForType(tok::TokenKind Op,
                              TypeDeclaration *Ty) {
   switch (Op) {
@@ -38,7 +68,8 @@ bool Sema::isOperatorForType(tok::TokenKind Op,
 }
 
 void Sema::checkFormalAndActualParameters(
-    SMLoc Loc, const FormalParamList &Formals,
+    SMLoc Loc,
+    ArrayRef<FormalParameterDeclaration *> Formals,
     const ExprList &Actuals) {
   if (Formals.size() != Actuals.size()) {
     Diags.report(Loc, diag::err_wrong_number_of_parameters);
@@ -62,27 +93,35 @@ void Sema::checkFormalAndActualParameters(
 
 void Sema::initialize() {
   // Setup global scope.
-  CurrentScope = new Scope();
   CurrentDecl = nullptr;
-  IntegerType = new PervasiveTypeDeclaration(
-      CurrentDecl, SMLoc(), "INTEGER");
-  BooleanType = new PervasiveTypeDeclaration(
-      CurrentDecl, SMLoc(), "BOOLEAN");
-  TrueLiteral = new BooleanLiteral(true, BooleanType);
-  FalseLiteral = new BooleanLiteral(false, BooleanType);
-  TrueConst = new ConstantDeclaration(CurrentDecl, SMLoc(),
-                                      "TRUE", TrueLiteral);
-  FalseConst = new ConstantDeclaration(
-      CurrentDecl, SMLoc(), "FALSE", FalseLiteral);
-  CurrentScope->insert(IntegerType);
-  CurrentScope->insert(BooleanType);
-  CurrentScope->insert(TrueConst);
-  CurrentScope->insert(FalseConst);
+  IntegerType = new (Allocator) PervasiveTypeDeclaration(
+      CurrentDecl, SourceOffset(),
+      getIdentifier("INTEGER"));
+  BooleanType = new (Allocator) PervasiveTypeDeclaration(
+      CurrentDecl, SourceOffset(),
+      getIdentifier("BOOLEAN"));
+  TrueLiteral =
+      new (Allocator) BooleanLiteral(true, BooleanType);
+  FalseLiteral =
+      new (Allocator) BooleanLiteral(false, BooleanType);
+  TrueConst = new (Allocator) ConstantDeclaration(
+      CurrentDecl, SourceOffset(), getIdentifier("TRUE"),
+      TrueLiteral);
+  FalseConst = new (Allocator) ConstantDeclaration(
+      CurrentDecl, SourceOffset(), getIdentifier("FALSE"),
+      FalseLiteral);
+  Symbols.insert(IntegerType);
+  Symbols.insert(BooleanType);
+  Symbols.insert(TrueConst);
+  Symbols.insert(FalseConst);
 }
 
 ModuleDeclaration *
 Sema::actOnModuleDeclaration(SMLoc Loc, StringRef Name) {
-  return new ModuleDeclaration(CurrentDecl, Loc, Name);
+  auto *Mod = new (Allocator) ModuleDeclaration(
+      CurrentDecl, getOffset(Loc), getIdentifier(Name));
+  Ctx.addDestruction(Mod);
+  return Mod;
 }
 
 void Sema::actOnModuleDeclaration(
@@ -94,23 +133,60 @@ void Sema::actOnModuleDeclaration(
     Diags.report(ModDecl->getLocation(),
                  diag::note_module_identifier_declaration);
   }
-  ModDecl->setDecls(Decls);
-  ModDecl->setStmts(Stmts);
+  ModDecl->setDecls(copyList(Decls));
+  ModDecl->setStmts(copyList(Stmts));
 }
 
-void Sema::actOnImport(StringRef ModuleName,
+ModuleDeclaration *Sema::loadModule(SMLoc Loc,
+                                   StringRef Name) {
+  if (auto *Mod =
+          dyn_cast_or_null<ModuleDeclaration>(CurrentDecl);
+      Mod && Mod->getName() == Name) {
+    Diags.report(Loc, diag::err_cyclic_import, Name);
+    return nullptr;
+  }
+  if (!Loader) {
+    Diags.report(Loc, diag::err_module_not_found, Name);
+    return nullptr;
+  }
+  return Loader->loadModule(Loc, Name);
+}
+
+void Sema::actOnImport(SMLoc Loc, StringRef ModuleName,
                        IdentList &Ids) {
-  Diags.report(SMLoc(), diag::err_not_yet_implemented);
+  // IMPORT X: declarations of X are accessed as X.Name.
+  if (ModuleName.empty()) {
+    for (auto &[IdLoc, Name] : Ids) {
+      ModuleDeclaration *Mod = loadModule(IdLoc, Name);
+      if (Mod && !Symbols.insert(Mod))
+        Diags.report(IdLoc, diag::err_symbold_declared,
+                     Name);
+    }
+    return;
+  }
+  // FROM X IMPORT Name: Name is accessed unqualified.
+  ModuleDeclaration *Mod = loadModule(Loc, ModuleName);
+  if (!Mod)
+    return;
+  for (auto &[IdLoc, Name] : Ids) {
+    Decl *D = Mod->getExternalSource()->lookup(Name);
+    if (!D)
+      Diags.report(IdLoc, diag::err_not_exported,
+                   ModuleName, Name);
+    else if (!Symbols.insert(D))
+      Diags.report(IdLoc, diag::err_symbold_declared, Name);
+  }
 }
 
 void Sema::actOnConstantDeclaration(DeclList &Decls,
                                     SMLoc Loc,
                                     StringRef Name,
                                     Expr *E) {
-  assert(CurrentScope && "CurrentScope not set");
   ConstantDeclaration *Decl =
-      new ConstantDeclaration(CurrentDecl, Loc, Name, E);
-  if (CurrentScope->insert(Decl))
+      new (Allocator) ConstantDeclaration(
+          CurrentDecl, getOffset(Loc), getIdentifier(Name),
+          E);
+  if (Symbols.insert(Decl))
     Decls.push_back(Decl);
   else
     Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -120,11 +196,12 @@ void Sema::actOnAliasTypeDeclaration(DeclList &Decls,
                                      SMLoc Loc,
                                      StringRef Name,
                                      Decl *D) {
-  assert(CurrentScope && "CurrentScope not set");
-  if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)) {
-    AliasTypeDeclaration *Decl = new AliasTypeDeclaration(
-        CurrentDecl, Loc, Name, Ty);
-    if (CurrentScope->insert(Decl))
+  if (TypeDeclaration *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
+    AliasTypeDeclaration *Decl =
+        new (Allocator) AliasTypeDeclaration(
+            CurrentDecl, getOffset(Loc),
+            getIdentifier(Name), Ty);
+    if (Symbols.insert(Decl))
       Decls.push_back(Decl);
     else
       Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -138,14 +215,15 @@ void Sema::actOnArrayTypeDeclaration(DeclList &Decls,
                                      SMLoc Loc,
                                      StringRef Name,
                                      Expr *E, Decl *D) {
-  assert(CurrentScope && "CurrentScope not set");
   if (E && E->isConst() &&
       E->getType()->getName() == "INTEGER") {
     if (TypeDeclaration *Ty =
-            dyn_cast<TypeDeclaration>(D)) {
-      ArrayTypeDeclaration *Decl = new ArrayTypeDeclaration(
-          CurrentDecl, Loc, Name, E, Ty);
-      if (CurrentScope->insert(Decl))
+            dyn_cast_or_null<TypeDeclaration>(D)) {
+      ArrayTypeDeclaration *Decl =
+          new (Allocator) ArrayTypeDeclaration(
+              CurrentDecl, getOffset(Loc),
+              getIdentifier(Name), E, Ty);
+      if (Symbols.insert(Decl))
         Decls.push_back(Decl);
       else
         Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -160,12 +238,12 @@ void Sema::actOnPointerTypeDeclaration(DeclList &Decls,
                                        SMLoc Loc,
                                        StringRef Name,
                                        Decl *D) {
-  assert(CurrentScope && "CurrentScope not set");
-  if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)) {
+  if (TypeDeclaration *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
     PointerTypeDeclaration *Decl =
-        new PointerTypeDeclaration(CurrentDecl, Loc, Name,
-                                   Ty);
-    if (CurrentScope->insert(Decl))
+        new (Allocator) PointerTypeDeclaration(
+            CurrentDecl, getOffset(Loc),
+            getIdentifier(Name), Ty);
+    if (Symbols.insert(Decl))
       Decls.push_back(Decl);
     else
       Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -177,11 +255,12 @@ void Sema::actOnPointerTypeDeclaration(DeclList &Decls,
 
 void Sema::actOnFieldDeclaration(FieldList &Fields,
                                  IdentList &Ids, Decl *D) {
-  if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)) {
+  if (TypeDeclaration *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
     for (auto I = Ids.begin(), E = Ids.end(); I != E; ++I) {
       SMLoc Loc = I->first;
       StringRef Name = I->second;
-      Fields.emplace_back(Loc, Name, Ty);
+      Fields.emplace_back(getOffset(Loc),
+                          getIdentifier(Name), Ty);
     }
   } else if (!Ids.empty()) {
     SMLoc Loc = Ids.front().first;
@@ -193,7 +272,6 @@ void Sema::actOnFieldDeclaration(FieldList &Fields,
 void Sema::actOnRecordTypeDeclaration(
     DeclList &Decls, SMLoc Loc, StringRef Name,
     const FieldList &Fields) {
-  assert(CurrentScope && "CurrentScope not set");
   llvm::StringSet<> FieldSet;
   for (const auto &F : Fields) {
     if (FieldSet.find(F.getName()) != FieldSet.end()) {
@@ -203,9 +281,12 @@ void Sema::actOnRecordTypeDeclaration(
     }
     FieldSet.insert(F.getName());
   }
-  RecordTypeDeclaration *Decl = new RecordTypeDeclaration(
-      CurrentDecl, Loc, Name, Fields);
-  if (CurrentScope->insert(Decl))
+  RecordTypeDeclaration *Decl =
+      new (Allocator) RecordTypeDeclaration(
+          CurrentDecl, getOffset(Loc), getIdentifier(Name),
+          copyList(Fields));
+  Ctx.addDestruction(Decl);
+  if (Symbols.insert(Decl))
     Decls.push_back(Decl);
   else
     Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -214,12 +295,12 @@ void Sema::actOnRecordTypeDeclaration(
 void Sema::actOnVariableDeclaration(DeclList &Decls,
                                     IdentList &Ids,
                                     Decl *D) {
-  assert(CurrentScope && "CurrentScope not set");
-  if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)) {
+  if (TypeDeclaration *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
     for (auto &[Loc, Name] : Ids) {
-      auto *Decl = new VariableDeclaration(CurrentDecl, Loc,
-                                           Name, Ty);
-      if (CurrentScope->insert(Decl))
+      auto *Decl = new (Allocator) VariableDeclaration(
+          CurrentDecl, getOffset(Loc), getIdentifier(Name),
+          Ty);
+      if (Symbols.insert(Decl))
         Decls.push_back(Decl);
       else
         Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -233,13 +314,13 @@ void Sema::actOnVariableDeclaration(DeclList &Decls,
 void Sema::actOnFormalParameterDeclaration(
     FormalParamList &Params, IdentList &Ids, Decl *D,
     bool IsVar) {
-  assert(CurrentScope && "CurrentScope not set");
-  if (TypeDeclaration *Ty = dyn_cast<TypeDeclaration>(D)) {
+  if (TypeDeclaration *Ty = dyn_cast_or_null<TypeDeclaration>(D)) {
     for (auto &[Loc, Name] : Ids) {
       FormalParameterDeclaration *Decl =
-          new FormalParameterDeclaration(CurrentDecl, Loc,
-                                         Name, Ty, IsVar);
-      if (CurrentScope->insert(Decl))
+          new (Allocator) FormalParameterDeclaration(
+              CurrentDecl, getOffset(Loc),
+              getIdentifier(Name), Ty, IsVar);
+      if (Symbols.insert(Decl))
         Params.push_back(Decl);
       else
         Diags.report(Loc, diag::err_symbold_declared, Name);
@@ -253,8 +334,9 @@ void Sema::actOnFormalParameterDeclaration(
 ProcedureDeclaration *
 Sema::actOnProcedureDeclaration(SMLoc Loc, StringRef Name) {
   ProcedureDeclaration *P =
-      new ProcedureDeclaration(CurrentDecl, Loc, Name);
-  if (!CurrentScope->insert(P))
+      new (Allocator) ProcedureDeclaration(
+          CurrentDecl, getOffset(Loc), getIdentifier(Name));
+  if (!Symbols.insert(P))
     Diags.report(Loc, diag::err_symbold_declared, Name);
   return P;
 }
@@ -262,7 +344,7 @@ Sema::actOnProcedureDeclaration(SMLoc Loc, StringRef Name) {
 void Sema::actOnProcedureHeading(
     ProcedureDeclaration *ProcDecl, FormalParamList &Params,
     Decl *RetType) {
-  ProcDecl->setFormalParams(Params);
+  ProcDecl->setFormalParams(copyList(Params));
   auto *RetTypeDecl =
       dyn_cast_or_null<TypeDeclaration>(RetType);
   if (!RetTypeDecl && RetType)
@@ -281,19 +363,43 @@ void Sema::actOnProcedureDeclaration(
     Diags.report(ProcDecl->getLocation(),
                  diag::note_proc_identifier_declaration);
   }
-  ProcDecl->setDecls(Decls);
-  ProcDecl->setStmts(Stmts);
+  ProcDecl->setDecls(copyList(Decls));
+  ProcDecl->setStmts(copyList(Stmts));
+}
+
+void Sema::actOnSkippedProcedureBody(
+    ProcedureDeclaration *ProcDecl, SMLoc Loc,
+    StringRef Name, SMLoc BodyLoc) {
+  if (Name != ProcDecl->getName()) {
+    Diags.report(Loc, diag::err_proc_identifier_not_equal);
+    Diags.report(ProcDecl->getLocation(),
+                 diag::note_proc_identifier_declaration);
+  }
+  // The current scope is the procedure's, so the others
+  // are the module and pervasive scopes.
+  SkippedBodies = true;
+  ProcDecl->setSkippedBody(getOffset(BodyLoc),
+                           Symbols.getNumOuterSymbols());
+}
+
+void Sema::actOnSkippedBodyParsed(
+    ProcedureDeclaration *ProcDecl, DeclList &Decls,
+    StmtList &Stmts) {
+  ProcDecl->setDecls(copyList(Decls));
+  ProcDecl->setStmts(copyList(Stmts));
+  ProcDecl->clearSkippedBody();
 }
 
 void Sema::actOnAssignment(StmtList &Stmts, SMLoc Loc,
                            Expr *D, Expr *E) {
-  if (auto Var = dyn_cast<Designator>(D)) {
-    if (Var->getType() != E->getType()) {
+  if (auto Var = dyn_cast_or_null<Designator>(D)) {
+    if (E && Var->getType() != E->getType()) {
       Diags.report(
           Loc, diag::err_types_for_operator_not_compatible,
           tok::getPunctuatorSpelling(tok::colonequal));
     }
-    Stmts.push_back(new AssignmentStatement(Var, E));
+    Stmts.push_back(
+        new (Allocator) AssignmentStatement(Var, E));
   } else if (D) {
     // TODO Emit error
   }
@@ -301,14 +407,14 @@ void Sema::actOnAssignment(StmtList &Stmts, SMLoc Loc,
 
 void Sema::actOnProcCall(StmtList &Stmts, SMLoc Loc,
                          Decl *D, ExprList &Params) {
-  if (auto Proc = dyn_cast<ProcedureDeclaration>(D)) {
+  if (auto Proc = dyn_cast_or_null<ProcedureDeclaration>(D)) {
     checkFormalAndActualParameters(
         Loc, Proc->getFormalParams(), Params);
     if (Proc->getRetType())
       Diags.report(
           Loc, diag::err_procedure_call_on_nonprocedure);
-    Stmts.push_back(
-        new ProcedureCallStatement(Proc, Params));
+    Stmts.push_back(ProcedureCallStatement::create(
+        Allocator, Proc, Params));
   } else if (D) {
     Diags.report(Loc,
                  diag::err_procedure_call_on_nonprocedure);
@@ -324,8 +430,8 @@ void Sema::actOnIfStatement(StmtList &Stmts, SMLoc Loc,
   if (Cond->getType() != BooleanType) {
     Diags.report(Loc, diag::err_if_expr_must_be_bool);
   }
-  Stmts.push_back(
-      new IfStatement(Cond, IfStmts, ElseStmts));
+  Stmts.push_back(IfStatement::create(Allocator, Cond,
+                                      IfStmts, ElseStmts));
 }
 
 void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc,
@@ -337,7 +443,8 @@ void Sema::actOnWhileStatement(StmtList &Stmts, SMLoc Loc,
   if (Cond->getType() != BooleanType) {
     Diags.report(Loc, diag::err_while_expr_must_be_bool);
   }
-  Stmts.push_back(new WhileStatement(Cond, WhileStmts));
+  Stmts.push_back(
+      WhileStatement::create(Allocator, Cond, WhileStmts));
 }
 
 void Sema::actOnReturnStatement(StmtList &Stmts, SMLoc Loc,
@@ -353,7 +460,7 @@ void Sema::actOnReturnStatement(StmtList &Stmts, SMLoc Loc,
       Diags.report(Loc, diag::err_function_and_return_type);
   }
 
-  Stmts.push_back(new ReturnStatement(RetVal));
+  Stmts.push_back(new (Allocator) ReturnStatement(RetVal));
 }
 
 Expr *Sema::actOnExpression(Expr *Left, Expr *Right,
@@ -371,8 +478,10 @@ Expr *Sema::actOnExpression(Expr *Left, Expr *Right,
         tok::getPunctuatorSpelling(Op.getKind()));
   }
   bool IsConst = Left->isConst() && Right->isConst();
-  return new InfixExpression(Left, Right, Op, BooleanType,
-                             IsConst);
+  return new (Allocator)
+      InfixExpression(Left, Right, Op.getKind(),
+                      getOffset(Op.getLocation()),
+                      BooleanType, IsConst);
 }
 
 Expr *Sema::actOnSimpleExpression(Expr *Left, Expr *Right,
@@ -397,7 +506,9 @@ Expr *Sema::actOnSimpleExpression(Expr *Left, Expr *Right,
     return L->getValue() || R->getValue() ? TrueLiteral
                                           : FalseLiteral;
   }
-  return new InfixExpression(Left, Right, Op, Ty, IsConst);
+  return new (Allocator) InfixExpression(
+      Left, Right, Op.getKind(),
+      getOffset(Op.getLocation()), Ty, IsConst);
 }
 
 Expr *Sema::actOnTerm(Expr *Left, Expr *Right,
@@ -423,7 +534,9 @@ Expr *Sema::actOnTerm(Expr *Left, Expr *Right,
     return L->getValue() && R->getValue() ? TrueLiteral
                                           : FalseLiteral;
   }
-  return new InfixExpression(Left, Right, Op, Ty, IsConst);
+  return new (Allocator) InfixExpression(
+      Left, Right, Op.getKind(),
+      getOffset(Op.getLocation()), Ty, IsConst);
 }
 
 Expr *Sema::actOnPrefixExpression(Expr *E,
@@ -449,8 +562,7 @@ Expr *Sema::actOnPrefixExpression(Expr *E,
         isa<ConstantAccess>(E))
       Ambiguous = false;
     else if (auto *Infix = dyn_cast<InfixExpression>(E)) {
-      tok::TokenKind Kind =
-          Infix->getOperatorInfo().getKind();
+      tok::TokenKind Kind = Infix->getOperatorKind();
       if (Kind == tok::star || Kind == tok::slash)
         Ambiguous = false;
     }
@@ -460,8 +572,9 @@ Expr *Sema::actOnPrefixExpression(Expr *E,
     }
   }
 
-  return new PrefixExpression(E, Op, E->getType(),
-                              E->isConst());
+  return new (Allocator) PrefixExpression(
+      E, Op.getKind(), getOffset(Op.getLocation()),
+      E->getType(), E->isConst());
 }
 
 Expr *Sema::actOnIntegerLiteral(SMLoc Loc,
@@ -472,15 +585,17 @@ Expr *Sema::actOnIntegerLiteral(SMLoc Loc,
     Radix = 16;
   }
   llvm::APInt Value(64, Literal, Radix);
-  return new IntegerLiteral(Loc, llvm::APSInt(Value, false),
-                            IntegerType);
+  return new (Allocator) IntegerLiteral(
+      getOffset(Loc), llvm::APSInt(Value, false),
+      IntegerType);
 }
 
 void Sema::actOnIndexSelector(Expr *Desig, SMLoc Loc,
                               Expr *E) {
   if (auto *D = dyn_cast<Designator>(Desig)) {
     if (auto *Ty = dyn_cast<ArrayTypeDeclaration>(D->getType())) {
-      D->addSelector(new IndexSelector(E, Ty->getType()));
+      D->addSelector(
+          new (Allocator) IndexSelector(E, Ty->getType()));
     }
   // TODO Error message
   }
@@ -493,14 +608,11 @@ void Sema::actOnFieldSelector(Expr *Desig, SMLoc Loc,
   if (auto *D = dyn_cast<Designator>(Desig)) {
     if (auto *R =
             dyn_cast<RecordTypeDeclaration>(D->getType())) {
-      uint32_t Index = 0;
-      for (const auto &F : R->getFields()) {
-        if (F.getName() == Name) {
-          D->addSelector(
-              new FieldSelector(Index, Name, F.getType()));
-          return;
-        }
-        ++Index;
+      if (auto Index = R->getFieldIndex(Name)) {
+        const Field &F = R->getFields()[*Index];
+        D->addSelector(new (Allocator) FieldSelector(
+            *Index, getIdentifier(Name), F.getType()));
+        return;
       }
       // TODO Error message
     }
@@ -513,7 +625,8 @@ void Sema::actOnDereferenceSelector(Expr *Desig,
                                     SMLoc Loc) {
   if (auto *D = dyn_cast<Designator>(Desig)) {
     if (auto *Ty = dyn_cast<PointerTypeDeclaration>(D->getType())) {
-      D->addSelector(new DereferenceSelector(Ty->getType()));
+      D->addSelector(new (Allocator) DereferenceSelector(
+          Ty->getType()));
     }
   // TODO Error message
   }
@@ -524,17 +637,17 @@ Expr *Sema::actOnDesignator(Decl *D) {
   if (!D)
     return nullptr;
   if (auto *V = dyn_cast<VariableDeclaration>(D))
-    return new Designator(V);
+    return new (Allocator) Designator(V);
   else if (auto *P =
                dyn_cast<FormalParameterDeclaration>(D))
-    return new Designator(P);
+    return new (Allocator) Designator(P);
   else if (auto *C = dyn_cast<ConstantDeclaration>(D)) {
     if (C == TrueConst)
       return TrueLiteral;
     if (C == FalseConst) {
       return FalseLiteral;
     }
-    return new ConstantAccess(C);
+    return new (Allocator) ConstantAccess(C);
   }
   return nullptr;
 }
@@ -544,11 +657,12 @@ Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params) {
     return nullptr;
   if (auto *P = dyn_cast<ProcedureDeclaration>(D)) {
     checkFormalAndActualParameters(
-        D->getLocation(), P->getFormalParams(), Params);
+        D->getLocation().getLoc(Diags.getSourceMgr()),
+        P->getFormalParams(), Params);
     if (!P->getRetType())
       Diags.report(D->getLocation(),
                    diag::err_function_call_on_nonfunction);
-    return new FunctionCallExpr(P, Params);
+    return FunctionCallExpr::create(Allocator, P, Params);
   }
   Diags.report(D->getLocation(),
                diag::err_function_call_on_nonfunction);
@@ -558,16 +672,16 @@ Expr *Sema::actOnFunctionCall(Decl *D, ExprList &Params) {
 Decl *Sema::actOnQualIdentPart(Decl *Prev, SMLoc Loc,
                                StringRef Name) {
   if (!Prev) {
-    if (Decl *D = CurrentScope->lookup(Name))
+    if (Decl *D = Symbols.lookup(Name))
       return D;
   } else if (auto *Mod =
                  dyn_cast<ModuleDeclaration>(Prev)) {
-    auto Decls = Mod->getDecls();
-    for (auto I = Decls.begin(), E = Decls.end(); I != E;
-         ++I) {
-      if ((*I)->getName() == Name) {
-        return *I;
-      }
+    if (Decl *D = Mod->lookup(Name))
+      return D;
+    if (Mod->getExternalSource()) {
+      Diags.report(Loc, diag::err_not_exported,
+                   Mod->getName(), Name);
+      return nullptr;
     }
   } else {
     llvm_unreachable("actOnQualIdentPart only callable "
@@ -0,0 +1,45 @@
+#include "tinylang/Sema/SymbolTable.h"
+#include "tinylang/AST/AST.h"
+
+using namespace tinylang;
+
+void SymbolTable::leaveScope() {
+  assert(!ScopeStarts.empty() &&
+         "Can't leave non-existing scope");
+  unsigned Start = ScopeStarts.pop_back_val();
+  // The entries stay in the map, empty, so entering the
+  // scope again does not allocate.
+  for (unsigned I = UndoLog.size(); I != Start; --I)
+    UndoLog[I - 1]->second.pop_back();
+  UndoLog.resize(Start);
+}
+
+bool SymbolTable::insert(Decl *D) {
+  SymbolMap::MapEntryTy &Entry =
+      *Symbols.try_emplace(D->getName()).first;
+  unsigned Level = getLevel();
+  if (!Entry.second.empty() &&
+      Entry.second.back().Level == Level)
+    return false;
+  Entry.second.push_back({D, Level});
+  UndoLog.push_back(&Entry);
+  return true;
+}
+
+void SymbolTable::getSymbols(
+    llvm::SmallVectorImpl<std::pair<Decl *, unsigned>> &Out)
+    const {
+  unsigned Level = 0;
+  for (unsigned I = 0, E = UndoLog.size(); I != E; ++I) {
+    while (Level < ScopeStarts.size() &&
+           ScopeStarts[Level] <= I)
+      ++Level;
+    // The binding made at I is still on its stack, below
+    // those of inner scopes, which were made later.
+    for (const Binding &B : UndoLog[I]->second)
+      if (B.Level == Level) {
+        Out.emplace_back(B.D, Level);
+        break;
+      }
+  }
+}
@@ -0,0 +1,89 @@
+#include "tinylang/Serialization/BuildRecord.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace tinylang;
+
+// A record is a text file of lines "<key> <values>":
+//
+//   tinylang-build-record 1
+//   source <hash>
+//   options <hash>
+//   interface <module> <hash>
+//   import <module> <hash>     (once per import)
+//
+// Hashes are hexadecimal.
+static const char *Header = "tinylang-build-record 1";
+
+std::optional<BuildRecord> BuildRecord::read(StringRef Path) {
+  auto BufferOrErr = llvm::MemoryBuffer::getFile(
+      Path, /*IsText=*/true);
+  if (!BufferOrErr)
+    return std::nullopt;
+  llvm::SmallVector<StringRef, 16> Lines;
+  (*BufferOrErr)
+      ->getBuffer()
+      .split(Lines, '\n', /*MaxSplit=*/-1,
+             /*KeepEmpty=*/false);
+  if (Lines.empty() || Lines[0] != Header)
+    return std::nullopt;
+
+  BuildRecord Rec;
+  bool HasSource = false, HasOptions = false,
+       HasInterface = false;
+  for (StringRef Line : llvm::drop_begin(Lines)) {
+    llvm::SmallVector<StringRef, 3> Fields;
+    Line.split(Fields, ' ');
+    uint64_t Hash;
+    if (Fields.back().getAsInteger(16, Hash))
+      return std::nullopt;
+    if (Fields.size() == 2 && Fields[0] == "source") {
+      Rec.SourceHash = Hash;
+      HasSource = true;
+    } else if (Fields.size() == 2 &&
+               Fields[0] == "options") {
+      Rec.OptionsHash = Hash;
+      HasOptions = true;
+    } else if (Fields.size() == 3 &&
+               Fields[0] == "interface") {
+      Rec.ModuleName = Fields[1].str();
+      Rec.InterfaceHash = Hash;
+      HasInterface = true;
+    } else if (Fields.size() == 3 &&
+               Fields[0] == "import") {
+      Rec.Imports.emplace_back(Fields[1].str(), Hash);
+    } else
+      return std::nullopt;
+  }
+  if (!HasSource || !HasOptions || !HasInterface)
+    return std::nullopt;
+  return Rec;
+}
+
+bool BuildRecord::write(StringRef Path) const {
+  // Written to a temporary file and renamed, so that a
+  // concurrent build never reads half a record.
+  llvm::Error Err = llvm::writeToOutput(
+      Path, [&](raw_ostream &OS) {
+        OS << Header << '\n';
+        OS << "source " << llvm::utohexstr(SourceHash)
+           << '\n';
+        OS << "options " << llvm::utohexstr(OptionsHash)
+           << '\n';
+        OS << "interface " << ModuleName << ' '
+           << llvm::utohexstr(InterfaceHash) << '\n';
+        for (const auto &[Name, Hash] : Imports)
+          OS << "import " << Name << ' '
+             << llvm::utohexstr(Hash) << '\n';
+        return llvm::Error::success();
+      });
+  if (Err) {
+    llvm::consumeError(std::move(Err));
+    return false;
+  }
+  return true;
+}
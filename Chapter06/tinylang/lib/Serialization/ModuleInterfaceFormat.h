@@ -0,0 +1,73 @@
+#ifndef TINYLANG_LIB_SERIALIZATION_MODULEINTERFACEFORMAT_H
+#define TINYLANG_LIB_SERIALIZATION_MODULEINTERFACEFORMAT_H
+
+#include <cstdint>
+
+// Layout of a module interface file. All numbers are
+// little endian and 32 bit unless noted, and offsets are
+// from the start of the file.
+//
+//   Header:
+//     char Magic[4]
+//     Version
+//     ModuleName    string
+//     NumDecls
+//     DeclOffsets   offset of u32[NumDecls], the offsets
+//                   of the declaration records
+//     NameIndex     offset of u32[NumDecls], declaration
+//                   numbers sorted by name
+//     NumExternals
+//     Externals     offset of {string Module, string
+//                   Name}[NumExternals], types declared
+//                   in other modules
+//     Strings       offset of the string table
+//     StringsSize
+//
+// A string is the offset of its length in the string
+// table, followed there by its bytes.
+//
+// A declaration record starts with its u8 RecordKind and
+// string Name. Then follow, by kind:
+//   Const:   TypeRef, i64 Value (0 or 1 for BOOLEAN)
+//   Alias:   TypeRef
+//   Array:   u64 NumElements, TypeRef of the elements
+//   Pointer: TypeRef
+//   Record:  NumFields, {string Name, TypeRef}[NumFields]
+//   Var:     TypeRef
+//   Proc:    TypeRef of the result, NumParams,
+//            {string Name, TypeRef, u8 IsVar}[NumParams]
+//
+// A declaration only refers to types declared before it,
+// so the records can be read in any order.
+
+namespace tinylang {
+namespace interface {
+
+constexpr char Magic[4] = {'T', 'L', 'I', '\0'};
+constexpr uint32_t Version = 1;
+constexpr uint32_t HeaderSize = 40;
+
+enum RecordKind : uint8_t {
+  RK_Const,
+  RK_AliasType,
+  RK_ArrayType,
+  RK_PointerType,
+  RK_RecordType,
+  RK_Var,
+  RK_Proc
+};
+
+// A TypeRef is one of these, the number of a
+// declaration plus FirstDeclRef, or the number of an
+// external type with ExternalRef set.
+enum : uint32_t {
+  NoTypeRef = 0,
+  IntegerTypeRef = 1,
+  BooleanTypeRef = 2,
+  FirstDeclRef = 3,
+  ExternalRef = 1u << 31
+};
+
+} // namespace interface
+} // namespace tinylang
+#endif
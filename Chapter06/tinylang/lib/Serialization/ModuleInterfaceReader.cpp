@@ -0,0 +1,460 @@
+#include "ModuleInterfaceFormat.h"
+#include "tinylang/Sema/Sema.h"
+#include "tinylang/Serialization/ModuleInterface.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
+#include <mutex>
+
+using namespace tinylang;
+using namespace tinylang::interface;
+
+namespace tinylang {
+// Provides the declarations of one module interface. The
+// whole file is checked when it is loaded, so creating a
+// declaration later can not fail.
+class ModuleInterfaceReader : public ExternalModuleSource {
+  struct Member {
+    StringRef Name;
+    uint32_t Type;
+    bool IsVar;
+  };
+
+  // A declaration record, decoded.
+  struct Record {
+    RecordKind Kind;
+    StringRef Name;
+    uint32_t Type = NoTypeRef;
+    uint64_t Value = 0;
+    llvm::SmallVector<Member, 4> Members;
+  };
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  ASTContext &Ctx;
+  // Declarations may be created on any thread, so the
+  // reader has an arena of its own.
+  llvm::BumpPtrAllocator &Allocator;
+  TypeDeclaration *IntegerType;
+  TypeDeclaration *BooleanType;
+  ModuleDeclaration *Mod = nullptr;
+
+  uint32_t NumDecls = 0;
+  uint32_t DeclOffsets = 0;
+  uint32_t NameIndex = 0;
+  uint32_t Strings = 0;
+  uint32_t StringsSize = 0;
+
+  // Types of other modules, resolved on loading.
+  std::vector<TypeDeclaration *> Externals;
+  // Declarations created so far, by number. Bodies parsed
+  // in parallel look up declarations concurrently.
+  std::vector<Decl *> Decls;
+  std::mutex Mutex;
+
+  StringRef data() const { return Buffer->getBuffer(); }
+
+  bool read32(uint32_t Offset, uint32_t &V) const {
+    if (Offset > data().size() || data().size() - Offset < 4)
+      return false;
+    V = llvm::support::endian::read32le(data().data() +
+                                        Offset);
+    return true;
+  }
+
+  bool readString(uint32_t Ref, StringRef &S) const {
+    uint32_t Size;
+    if (Ref > StringsSize || StringsSize - Ref < 4 ||
+        !read32(Strings + Ref, Size) ||
+        StringsSize - Ref - 4 < Size)
+      return false;
+    S = data().substr(Strings + Ref + 4, Size);
+    return true;
+  }
+
+  // Checks that Ref can be resolved from declaration
+  // number Number.
+  bool isValidTypeRef(uint32_t Ref, uint32_t Number) const;
+  bool readRecord(uint32_t Number, Record &R) const;
+  bool findDecl(StringRef Name, uint32_t &Number) const;
+
+  TypeDeclaration *getType(uint32_t Ref);
+  Decl *getDecl(uint32_t Number);
+
+public:
+  ModuleInterfaceReader(
+      std::unique_ptr<llvm::MemoryBuffer> Buffer,
+      ASTContext &Ctx, TypeDeclaration *IntegerType,
+      TypeDeclaration *BooleanType)
+      : Buffer(std::move(Buffer)), Ctx(Ctx),
+        Allocator(Ctx.createAllocator()),
+        IntegerType(IntegerType),
+        BooleanType(BooleanType) {}
+
+  /// Checks the file, and loads the modules it refers to
+  /// with Loader. Returns false if the file is invalid.
+  bool load(ModuleLoader &Loader, SMLoc Loc,
+            StringRef Name);
+
+  ModuleDeclaration *getModule() { return Mod; }
+
+  uint64_t hash() const {
+    return hashModuleInterface(data());
+  }
+
+  Decl *lookup(StringRef Name) override;
+};
+} // namespace tinylang
+
+bool ModuleInterfaceReader::isValidTypeRef(
+    uint32_t Ref, uint32_t Number) const {
+  if (Ref == IntegerTypeRef || Ref == BooleanTypeRef)
+    return true;
+  if (Ref & ExternalRef)
+    return (Ref & ~ExternalRef) < Externals.size();
+  if (Ref < FirstDeclRef || Ref - FirstDeclRef >= Number)
+    return false;
+  Record R;
+  return readRecord(Ref - FirstDeclRef, R) &&
+         R.Kind >= RK_AliasType && R.Kind <= RK_RecordType;
+}
+
+bool ModuleInterfaceReader::readRecord(uint32_t Number,
+                                       Record &R) const {
+  uint32_t Offset;
+  if (!read32(DeclOffsets + 4 * Number, Offset) ||
+      Offset >= data().size())
+    return false;
+  R.Kind = RecordKind(data()[Offset++]);
+  uint32_t NameRef, Lo, Hi, Count;
+  if (!read32(Offset, NameRef) || !readString(NameRef, R.Name))
+    return false;
+  Offset += 4;
+  switch (R.Kind) {
+  case RK_Const:
+    if (!read32(Offset, R.Type) || !read32(Offset + 4, Lo) ||
+        !read32(Offset + 8, Hi))
+      return false;
+    R.Value = uint64_t(Hi) << 32 | Lo;
+    return R.Type == IntegerTypeRef ||
+           R.Type == BooleanTypeRef;
+  case RK_ArrayType:
+    if (!read32(Offset, Lo) || !read32(Offset + 4, Hi))
+      return false;
+    R.Value = uint64_t(Hi) << 32 | Lo;
+    Offset += 8;
+    [[fallthrough]];
+  case RK_AliasType:
+  case RK_PointerType:
+  case RK_Var:
+    return read32(Offset, R.Type);
+  case RK_RecordType:
+  case RK_Proc:
+    if (R.Kind == RK_Proc) {
+      if (!read32(Offset, R.Type))
+        return false;
+      Offset += 4;
+    }
+    if (!read32(Offset, Count))
+      return false;
+    Offset += 4;
+    for (uint32_t I = 0; I != Count; ++I) {
+      Member M;
+      if (!read32(Offset, NameRef) ||
+          !readString(NameRef, M.Name) ||
+          !read32(Offset + 4, M.Type))
+        return false;
+      Offset += 8;
+      M.IsVar = false;
+      if (R.Kind == RK_Proc) {
+        if (Offset >= data().size())
+          return false;
+        M.IsVar = data()[Offset++];
+      }
+      R.Members.push_back(M);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ModuleInterfaceReader::load(ModuleLoader &Loader,
+                                 SMLoc Loc,
+                                 StringRef Name) {
+  uint32_t V, ModuleName, NumExternals, ExternalsOffset;
+  if (data().size() < HeaderSize ||
+      !data().startswith(StringRef(Magic, sizeof(Magic))) ||
+      !read32(4, V) || V != Version)
+    return false;
+  if (!read32(8, ModuleName) || !read32(12, NumDecls) ||
+      !read32(16, DeclOffsets) || !read32(20, NameIndex) ||
+      !read32(24, NumExternals) ||
+      !read32(28, ExternalsOffset) ||
+      !read32(32, Strings) || !read32(36, StringsSize))
+    return false;
+  uint64_t Size = data().size();
+  if (uint64_t(DeclOffsets) + 4ull * NumDecls > Size ||
+      uint64_t(NameIndex) + 4ull * NumDecls > Size ||
+      uint64_t(ExternalsOffset) + 8ull * NumExternals >
+          Size ||
+      uint64_t(Strings) + StringsSize > Size)
+    return false;
+  StringRef ModName;
+  if (!readString(ModuleName, ModName) || ModName != Name)
+    return false;
+  Mod = new (Allocator) ModuleDeclaration(
+      nullptr, SourceOffset(), Ctx.getIdentifier(ModName));
+  Ctx.addDestruction(Mod);
+  Mod->setExternalSource(this);
+
+  // The types of other modules are needed to check the
+  // declarations.
+  for (uint32_t I = 0; I != NumExternals; ++I) {
+    uint32_t ModRef, NameRef;
+    StringRef OtherName, TypeName;
+    if (!read32(ExternalsOffset + 8 * I, ModRef) ||
+        !read32(ExternalsOffset + 8 * I + 4, NameRef) ||
+        !readString(ModRef, OtherName) ||
+        !readString(NameRef, TypeName))
+      return false;
+    ModuleDeclaration *Other =
+        Loader.loadModule(Loc, OtherName);
+    if (!Other)
+      return false;
+    auto *Ty = dyn_cast_or_null<TypeDeclaration>(
+        Other->getExternalSource()->lookup(TypeName));
+    if (!Ty)
+      return false;
+    Externals.push_back(Ty);
+  }
+
+  for (uint32_t I = 0; I != NumDecls; ++I) {
+    Record R;
+    if (!readRecord(I, R))
+      return false;
+    // Records have only the types of their fields, and
+    // procedures may have no result.
+    bool HasType = R.Kind != RK_RecordType &&
+                   !(R.Kind == RK_Proc && R.Type == NoTypeRef);
+    if (HasType && !isValidTypeRef(R.Type, I))
+      return false;
+    for (const Member &M : R.Members)
+      if (!isValidTypeRef(M.Type, I))
+        return false;
+  }
+
+  // The name index must be sorted for the binary search.
+  StringRef Prev;
+  for (uint32_t I = 0; I != NumDecls; ++I) {
+    uint32_t Number;
+    Record R;
+    if (!read32(NameIndex + 4 * I, Number) ||
+        Number >= NumDecls || !readRecord(Number, R) ||
+        (I && R.Name < Prev))
+      return false;
+    Prev = R.Name;
+  }
+  Decls.resize(NumDecls);
+  return true;
+}
+
+bool ModuleInterfaceReader::findDecl(
+    StringRef Name, uint32_t &Number) const {
+  uint32_t Lo = 0, Hi = NumDecls;
+  while (Lo < Hi) {
+    uint32_t Mid = Lo + (Hi - Lo) / 2;
+    Record R;
+    if (!read32(NameIndex + 4 * Mid, Number) ||
+        !readRecord(Number, R))
+      return false;
+    if (R.Name == Name)
+      return true;
+    if (R.Name < Name)
+      Lo = Mid + 1;
+    else
+      Hi = Mid;
+  }
+  return false;
+}
+
+TypeDeclaration *ModuleInterfaceReader::getType(uint32_t Ref) {
+  if (Ref == IntegerTypeRef)
+    return IntegerType;
+  if (Ref == BooleanTypeRef)
+    return BooleanType;
+  if (Ref & ExternalRef)
+    return Externals[Ref & ~ExternalRef];
+  return cast_or_null<TypeDeclaration>(
+      getDecl(Ref - FirstDeclRef));
+}
+
+Decl *ModuleInterfaceReader::getDecl(uint32_t Number) {
+  if (Decl *D = Decls[Number])
+    return D;
+  // load() checked every record already.
+  Record R;
+  if (!readRecord(Number, R))
+    return nullptr;
+  Identifier Name = Ctx.getIdentifier(R.Name);
+  Decl *D = nullptr;
+  switch (R.Kind) {
+  case RK_Const: {
+    Expr *E;
+    if (R.Type == BooleanTypeRef)
+      E = new (Allocator)
+          BooleanLiteral(R.Value != 0, BooleanType);
+    else
+      E = new (Allocator) IntegerLiteral(
+          SourceOffset(),
+          llvm::APSInt(llvm::APInt(64, R.Value), false),
+          IntegerType);
+    D = new (Allocator)
+        ConstantDeclaration(Mod, SourceOffset(), Name, E);
+    break;
+  }
+  case RK_AliasType:
+    D = new (Allocator) AliasTypeDeclaration(
+        Mod, SourceOffset(), Name, getType(R.Type));
+    break;
+  case RK_ArrayType: {
+    Expr *Nums = new (Allocator) IntegerLiteral(
+        SourceOffset(),
+        llvm::APSInt(llvm::APInt(64, R.Value), false),
+        IntegerType);
+    D = new (Allocator) ArrayTypeDeclaration(
+        Mod, SourceOffset(), Name, Nums, getType(R.Type));
+    break;
+  }
+  case RK_PointerType:
+    D = new (Allocator) PointerTypeDeclaration(
+        Mod, SourceOffset(), Name, getType(R.Type));
+    break;
+  case RK_RecordType: {
+    FieldList Fields;
+    for (const Member &M : R.Members)
+      Fields.emplace_back(SourceOffset(),
+                          Ctx.getIdentifier(M.Name),
+                          getType(M.Type));
+    auto *Record = new (Allocator) RecordTypeDeclaration(
+        Mod, SourceOffset(), Name,
+        ASTContext::copyArray(Allocator,
+                              ArrayRef<Field>(Fields)));
+    Ctx.addDestruction(Record);
+    D = Record;
+    break;
+  }
+  case RK_Var:
+    D = new (Allocator) VariableDeclaration(
+        Mod, SourceOffset(), Name, getType(R.Type));
+    break;
+  case RK_Proc: {
+    auto *Proc = new (Allocator)
+        ProcedureDeclaration(Mod, SourceOffset(), Name);
+    FormalParamList Params;
+    for (const Member &M : R.Members)
+      Params.push_back(
+          new (Allocator) FormalParameterDeclaration(
+              Proc, SourceOffset(),
+              Ctx.getIdentifier(M.Name), getType(M.Type),
+              M.IsVar));
+    Proc->setFormalParams(ASTContext::copyArray(
+        Allocator,
+        ArrayRef<FormalParameterDeclaration *>(Params)));
+    Proc->setRetType(R.Type == NoTypeRef ? nullptr
+                                         : getType(R.Type));
+    D = Proc;
+    break;
+  }
+  }
+  return Decls[Number] = D;
+}
+
+Decl *ModuleInterfaceReader::lookup(StringRef Name) {
+  uint32_t Number;
+  if (!findDecl(Name, Number))
+    return nullptr;
+  std::lock_guard<std::mutex> Guard(Mutex);
+  return getDecl(Number);
+}
+
+std::string tinylang::findModuleInterface(
+    llvm::ArrayRef<std::string> SearchPath, StringRef Name) {
+  for (const std::string &Dir : SearchPath) {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path,
+                            Name + ModuleInterfaceExtension);
+    if (llvm::sys::fs::exists(Path))
+      return std::string(Path);
+  }
+  return std::string();
+}
+
+uint64_t tinylang::hashModuleInterface(StringRef Contents) {
+  return llvm::xxHash64(Contents);
+}
+
+ModuleInterfaceLoader::ModuleInterfaceLoader(
+    DiagnosticsEngine &Diags, Sema &Actions,
+    llvm::ArrayRef<std::string> SearchPath)
+    : Diags(Diags), Ctx(Actions.getASTContext()),
+      IntegerType(Actions.getIntegerType()),
+      BooleanType(Actions.getBooleanType()),
+      SearchPath(SearchPath.begin(), SearchPath.end()) {}
+
+ModuleInterfaceLoader::~ModuleInterfaceLoader() = default;
+
+ModuleDeclaration *
+ModuleInterfaceLoader::loadModule(SMLoc Loc,
+                                  StringRef Name) {
+  auto I = Modules.find(Name);
+  if (I != Modules.end())
+    return I->second ? I->second->getModule() : nullptr;
+  if (Loading.count(Name)) {
+    Diags.report(Loc, diag::err_cyclic_import, Name);
+    return nullptr;
+  }
+
+  std::string Path = findModuleInterface(SearchPath, Name);
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  if (!Path.empty()) {
+    auto BufferOrErr = llvm::MemoryBuffer::getFile(
+        Path, /*IsText=*/false,
+        /*RequiresNullTerminator=*/false);
+    if (BufferOrErr)
+      Buffer = std::move(*BufferOrErr);
+  }
+  if (!Buffer) {
+    Diags.report(Loc, diag::err_module_not_found, Name);
+    Modules[Name] = nullptr;
+    return nullptr;
+  }
+
+  Loading.insert(Name);
+  auto Reader = std::make_unique<ModuleInterfaceReader>(
+      std::move(Buffer), Ctx, IntegerType, BooleanType);
+  bool Valid = Reader->load(*this, Loc, Name);
+  Loading.erase(Name);
+  if (!Valid) {
+    Diags.report(Loc, diag::err_invalid_module_interface,
+                 Path);
+    Reader.reset();
+  }
+  ModuleDeclaration *Mod =
+      Reader ? Reader->getModule() : nullptr;
+  Modules[Name] = std::move(Reader);
+  return Mod;
+}
+
+std::vector<std::pair<std::string, uint64_t>>
+ModuleInterfaceLoader::getLoadedInterfaces() const {
+  std::vector<std::pair<std::string, uint64_t>> Loaded;
+  for (const auto &M : Modules)
+    if (M.second)
+      Loaded.emplace_back(M.first().str(), M.second->hash());
+  llvm::sort(Loaded);
+  return Loaded;
+}
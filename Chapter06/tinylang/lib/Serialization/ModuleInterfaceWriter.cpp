@@ -0,0 +1,282 @@
+#include "ModuleInterfaceFormat.h"
+#include "tinylang/Serialization/ModuleInterface.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Endian.h"
+#include <algorithm>
+#include <optional>
+
+using namespace tinylang;
+using namespace tinylang::interface;
+
+namespace {
+// Computes the value of a constant expression the way the
+// generated code would: INTEGER arithmetic wraps, and a
+// BOOLEAN is 0 or 1. Nothing if the value is undefined.
+std::optional<int64_t> evaluate(Expr *E) {
+  if (auto *Int = dyn_cast<IntegerLiteral>(E))
+    return Int->getValue().getZExtValue();
+  if (auto *Bool = dyn_cast<BooleanLiteral>(E))
+    return Bool->getValue();
+  if (auto *Const = dyn_cast<ConstantAccess>(E))
+    return evaluate(Const->getDecl()->getExpr());
+  if (auto *Prefix = dyn_cast<PrefixExpression>(E)) {
+    std::optional<int64_t> V = evaluate(Prefix->getExpr());
+    if (!V)
+      return std::nullopt;
+    switch (Prefix->getOperatorKind()) {
+    case tok::plus:
+      return V;
+    case tok::minus:
+      return int64_t(0 - uint64_t(*V));
+    case tok::kw_NOT:
+      return !*V;
+    default:
+      return std::nullopt;
+    }
+  }
+  auto *Infix = dyn_cast<InfixExpression>(E);
+  if (!Infix)
+    return std::nullopt;
+  std::optional<int64_t> L = evaluate(Infix->getLeft());
+  std::optional<int64_t> R = evaluate(Infix->getRight());
+  if (!L || !R)
+    return std::nullopt;
+  uint64_t UL = *L, UR = *R;
+  switch (Infix->getOperatorKind()) {
+  case tok::plus:
+    return int64_t(UL + UR);
+  case tok::minus:
+    return int64_t(UL - UR);
+  case tok::star:
+    return int64_t(UL * UR);
+  case tok::kw_DIV:
+  case tok::kw_MOD:
+    if (*R == 0 || (*L == INT64_MIN && *R == -1))
+      return std::nullopt;
+    return Infix->getOperatorKind() == tok::kw_DIV
+               ? *L / *R
+               : *L % *R;
+  case tok::kw_AND:
+    return *L && *R;
+  case tok::kw_OR:
+    return *L || *R;
+  case tok::equal:
+    return *L == *R;
+  case tok::hash:
+    return *L != *R;
+  case tok::less:
+    return *L < *R;
+  case tok::lessequal:
+    return *L <= *R;
+  case tok::greater:
+    return *L > *R;
+  case tok::greaterequal:
+    return *L >= *R;
+  default:
+    return std::nullopt;
+  }
+}
+
+void append32(std::string &Buf, uint32_t V) {
+  char Bytes[4];
+  llvm::support::endian::write32le(Bytes, V);
+  Buf.append(Bytes, 4);
+}
+
+void append64(std::string &Buf, uint64_t V) {
+  char Bytes[8];
+  llvm::support::endian::write64le(Bytes, V);
+  Buf.append(Bytes, 8);
+}
+
+class InterfaceWriter {
+  ModuleDeclaration *Mod;
+
+  // The declaration records, and where each starts.
+  std::string Records;
+  std::vector<uint32_t> RecordOffsets;
+  // The written declarations with their numbers.
+  llvm::DenseMap<Decl *, uint32_t> DeclNumbers;
+  std::vector<Decl *> WrittenDecls;
+
+  std::string Strings;
+  StringMap<uint32_t> StringOffsets;
+
+  std::vector<std::pair<uint32_t, uint32_t>> Externals;
+  llvm::DenseMap<Decl *, uint32_t> ExternalNumbers;
+
+  uint32_t addString(StringRef S) {
+    auto [I, Inserted] =
+        StringOffsets.try_emplace(S, Strings.size());
+    if (Inserted) {
+      append32(Strings, S.size());
+      Strings.append(S.begin(), S.end());
+    }
+    return I->second;
+  }
+
+  // Nothing if Ty is not part of the interface.
+  std::optional<uint32_t> typeRef(TypeDeclaration *Ty) {
+    if (isa<PervasiveTypeDeclaration>(Ty))
+      return Ty->getName() == "BOOLEAN" ? BooleanTypeRef
+                                        : IntegerTypeRef;
+    auto I = DeclNumbers.find(Ty);
+    if (I != DeclNumbers.end())
+      return FirstDeclRef + I->second;
+    auto *Owner =
+        dyn_cast_or_null<ModuleDeclaration>(
+            Ty->getEnclosingDecl());
+    if (!Owner || Owner == Mod)
+      return std::nullopt;
+    auto [E, Inserted] = ExternalNumbers.try_emplace(
+        Ty, Externals.size());
+    if (Inserted)
+      Externals.emplace_back(addString(Owner->getName()),
+                             addString(Ty->getName()));
+    return ExternalRef | E->second;
+  }
+
+  // Appends the record of D to Rec, or returns false if D
+  // can not be part of the interface.
+  bool writeDecl(Decl *D, std::string &Rec);
+
+public:
+  InterfaceWriter(ModuleDeclaration *Mod) : Mod(Mod) {}
+
+  void write(raw_ostream &OS);
+};
+} // namespace
+
+bool InterfaceWriter::writeDecl(Decl *D, std::string &Rec) {
+  auto Kind = [&Rec](RecordKind K) { Rec.push_back(K); };
+  auto Type = [&](TypeDeclaration *Ty) {
+    std::optional<uint32_t> Ref = typeRef(Ty);
+    if (Ref)
+      append32(Rec, *Ref);
+    return Ref.has_value();
+  };
+  if (auto *Const = dyn_cast<ConstantDeclaration>(D)) {
+    std::optional<int64_t> Value =
+        evaluate(Const->getExpr());
+    if (!Value)
+      return false;
+    Kind(RK_Const);
+    append32(Rec, addString(D->getName()));
+    if (!Type(Const->getExpr()->getType()))
+      return false;
+    append64(Rec, *Value);
+  } else if (auto *Alias =
+                 dyn_cast<AliasTypeDeclaration>(D)) {
+    Kind(RK_AliasType);
+    append32(Rec, addString(D->getName()));
+    return Type(Alias->getType());
+  } else if (auto *Array =
+                 dyn_cast<ArrayTypeDeclaration>(D)) {
+    std::optional<int64_t> NumElements =
+        evaluate(Array->getNums());
+    if (!NumElements)
+      return false;
+    Kind(RK_ArrayType);
+    append32(Rec, addString(D->getName()));
+    append64(Rec, *NumElements);
+    return Type(Array->getType());
+  } else if (auto *Pointer =
+                 dyn_cast<PointerTypeDeclaration>(D)) {
+    Kind(RK_PointerType);
+    append32(Rec, addString(D->getName()));
+    return Type(Pointer->getType());
+  } else if (auto *Record =
+                 dyn_cast<RecordTypeDeclaration>(D)) {
+    Kind(RK_RecordType);
+    append32(Rec, addString(D->getName()));
+    append32(Rec, Record->getFields().size());
+    for (const Field &F : Record->getFields()) {
+      append32(Rec, addString(F.getName()));
+      if (!Type(F.getType()))
+        return false;
+    }
+  } else if (auto *Var = dyn_cast<VariableDeclaration>(D)) {
+    Kind(RK_Var);
+    append32(Rec, addString(D->getName()));
+    return Type(Var->getType());
+  } else if (auto *Proc =
+                 dyn_cast<ProcedureDeclaration>(D)) {
+    Kind(RK_Proc);
+    append32(Rec, addString(D->getName()));
+    if (!Proc->getRetType())
+      append32(Rec, NoTypeRef);
+    else if (!Type(Proc->getRetType()))
+      return false;
+    append32(Rec, Proc->getFormalParams().size());
+    for (FormalParameterDeclaration *FP :
+         Proc->getFormalParams()) {
+      append32(Rec, addString(FP->getName()));
+      if (!Type(FP->getType()))
+        return false;
+      Rec.push_back(FP->isVar());
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void InterfaceWriter::write(raw_ostream &OS) {
+  uint32_t ModuleName = addString(Mod->getName());
+  std::string Rec;
+  for (Decl *D : Mod->getDecls()) {
+    Rec.clear();
+    // Strings and externals of a left out declaration
+    // are kept; they are harmless.
+    if (!writeDecl(D, Rec))
+      continue;
+    DeclNumbers[D] = WrittenDecls.size();
+    WrittenDecls.push_back(D);
+    RecordOffsets.push_back(Records.size());
+    Records += Rec;
+  }
+
+  uint32_t NumDecls = WrittenDecls.size();
+  std::vector<uint32_t> NameIndex(NumDecls);
+  for (uint32_t I = 0; I != NumDecls; ++I)
+    NameIndex[I] = I;
+  std::sort(NameIndex.begin(), NameIndex.end(),
+            [this](uint32_t A, uint32_t B) {
+              return WrittenDecls[A]->getName() <
+                     WrittenDecls[B]->getName();
+            });
+
+  // Sections follow the header in this order.
+  uint32_t DeclOffsets = HeaderSize;
+  uint32_t NameIndexOffset = DeclOffsets + 4 * NumDecls;
+  uint32_t ExternalsOffset = NameIndexOffset + 4 * NumDecls;
+  uint32_t StringsOffset =
+      ExternalsOffset + 8 * Externals.size();
+  uint32_t RecordsOffset = StringsOffset + Strings.size();
+
+  std::string Out;
+  Out.append(Magic, sizeof(Magic));
+  append32(Out, Version);
+  append32(Out, ModuleName);
+  append32(Out, NumDecls);
+  append32(Out, DeclOffsets);
+  append32(Out, NameIndexOffset);
+  append32(Out, Externals.size());
+  append32(Out, ExternalsOffset);
+  append32(Out, StringsOffset);
+  append32(Out, Strings.size());
+  for (uint32_t Offset : RecordOffsets)
+    append32(Out, RecordsOffset + Offset);
+  for (uint32_t Number : NameIndex)
+    append32(Out, Number);
+  for (auto [Module, Name] : Externals) {
+    append32(Out, Module);
+    append32(Out, Name);
+  }
+  OS << Out << Strings << Records;
+}
+
+void tinylang::writeModuleInterface(ModuleDeclaration *Mod,
+                                    raw_ostream &OS) {
+  InterfaceWriter(Mod).write(OS);
+}
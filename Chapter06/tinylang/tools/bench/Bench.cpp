@@ -0,0 +1,367 @@
+#include "WorkloadGenerator.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/Version.h"
+#include "tinylang/CodeGen/CodeGenerator.h"
+#include "tinylang/Parser/Parser.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/TargetParser/Host.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <optional>
+
+using namespace llvm;
+using namespace tinylang;
+
+// Every allocation through operator new is counted, so
+// that each phase can report how much it allocated.
+static std::atomic<uint64_t> AllocatedBytes{0};
+static std::atomic<uint64_t> NumAllocations{0};
+
+static void *countedAlloc(size_t Size, size_t Align = 0) {
+  AllocatedBytes.fetch_add(Size, std::memory_order_relaxed);
+  NumAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (!Size)
+    Size = 1;
+  void *Ptr =
+      Align > alignof(std::max_align_t)
+          ? std::aligned_alloc(Align, alignTo(Size, Align))
+          : std::malloc(Size);
+  if (!Ptr)
+    report_bad_alloc_error("Allocation failed");
+  return Ptr;
+}
+
+void *operator new(size_t Size) { return countedAlloc(Size); }
+void *operator new[](size_t Size) {
+  return countedAlloc(Size);
+}
+void *operator new(size_t Size, std::align_val_t Align) {
+  return countedAlloc(Size, static_cast<size_t>(Align));
+}
+void *operator new[](size_t Size, std::align_val_t Align) {
+  return countedAlloc(Size, static_cast<size_t>(Align));
+}
+void operator delete(void *Ptr) noexcept { std::free(Ptr); }
+void operator delete[](void *Ptr) noexcept {
+  std::free(Ptr);
+}
+void operator delete(void *Ptr, size_t) noexcept {
+  std::free(Ptr);
+}
+void operator delete[](void *Ptr, size_t) noexcept {
+  std::free(Ptr);
+}
+void operator delete(void *Ptr, std::align_val_t) noexcept {
+  std::free(Ptr);
+}
+void operator delete[](void *Ptr,
+                       std::align_val_t) noexcept {
+  std::free(Ptr);
+}
+void operator delete(void *Ptr, size_t,
+                     std::align_val_t) noexcept {
+  std::free(Ptr);
+}
+void operator delete[](void *Ptr, size_t,
+                       std::align_val_t) noexcept {
+  std::free(Ptr);
+}
+
+static cl::list<std::string> InputFiles(
+    cl::Positional,
+    cl::desc("[<input-files>] (default: a generated "
+             "module)"));
+
+static cl::opt<unsigned>
+    Procedures("procedures",
+               cl::desc("Number of procedures"),
+               cl::init(100));
+
+static cl::opt<unsigned> Statements(
+    "statements",
+    cl::desc("Statements per procedure, including nested "
+             "ones"),
+    cl::init(20));
+
+static cl::opt<unsigned>
+    NestingDepth("nesting",
+                 cl::desc("Maximum IF/WHILE nesting depth"),
+                 cl::init(2));
+
+static cl::opt<unsigned>
+    ExpressionDepth("expr-depth",
+                    cl::desc("Maximum expression depth"),
+                    cl::init(3));
+
+static cl::opt<bool>
+    Arrays("arrays",
+           cl::desc("Declare and assign array variables"),
+           cl::init(true));
+
+static cl::opt<bool>
+    Records("records",
+            cl::desc("Declare and assign record variables"),
+            cl::init(true));
+
+static cl::opt<unsigned>
+    Seed("seed", cl::desc("Seed of the generator"),
+         cl::init(1));
+
+static cl::opt<bool> DumpWorkload(
+    "dump-workload",
+    cl::desc("Print the generated module and exit"),
+    cl::init(false));
+
+static cl::opt<unsigned> Iterations(
+    "iterations",
+    cl::desc("Number of times each input is compiled; the "
+             "fastest run is reported"),
+    cl::init(5));
+
+static cl::opt<bool> Backend(
+    "backend",
+    cl::desc("Also time emitting an object file for the "
+             "host"),
+    cl::init(false));
+
+static cl::opt<bool> SkipBodies(
+    "skip-bodies",
+    cl::desc("Skip procedure bodies when parsing, and "
+             "parse them afterwards in a phase of their "
+             "own"),
+    cl::init(false));
+
+static cl::opt<unsigned> ParseThreads(
+    "parse-threads",
+    cl::desc("Number of threads parsing the skipped "
+             "procedure bodies (0 = one per core); other "
+             "than 1 implies -skip-bodies"),
+    cl::init(1));
+
+static const char *Head =
+    "tinylang-bench - Tinylang compile-time benchmark";
+
+namespace {
+enum Phase {
+  LexPhase,
+  ParsePhase,
+  BodiesPhase,
+  CodeGenPhase,
+  BackendPhase,
+  NumPhases
+};
+
+const char *PhaseNames[NumPhases] = {
+    "lex", "parse+sema", "bodies", "codegen", "backend"};
+
+// Fastest run of a phase, and what it allocated.
+struct PhaseStats {
+  double Seconds = std::numeric_limits<double>::max();
+  uint64_t Bytes = 0;
+  uint64_t Allocations = 0;
+  bool Ran = false;
+};
+
+template <typename Fn>
+void measure(PhaseStats &Stats, Fn &&Body) {
+  uint64_t Bytes = AllocatedBytes.load();
+  uint64_t Allocations = NumAllocations.load();
+  auto Start = std::chrono::steady_clock::now();
+  Body();
+  double Seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() -
+                       Start)
+                       .count();
+  Stats.Seconds = std::min(Stats.Seconds, Seconds);
+  Stats.Bytes = AllocatedBytes.load() - Bytes;
+  Stats.Allocations = NumAllocations.load() - Allocations;
+  Stats.Ran = true;
+}
+
+// Runs every phase over Source once. The parser drives
+// the semantic actions, so both are timed together, and
+// include lexing. Creating the lexer, which builds its
+// keyword table, and Sema is not timed. With BodyPool,
+// the skipped bodies are parsed on its threads.
+bool compileOnce(StringRef Name, StringRef Source,
+                 llvm::TargetMachine *TM,
+                 llvm::ThreadPool *BodyPool,
+                 PhaseStats (&Stats)[NumPhases]) {
+  llvm::SourceMgr SrcMgr;
+  DiagnosticsEngine Diags(SrcMgr);
+  SrcMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(Source, Name),
+      llvm::SMLoc());
+
+  measure(Stats[LexPhase], [&] {
+    Lexer Lex(SrcMgr, Diags);
+    Token Tok;
+    do
+      Lex.next(Tok);
+    while (!Tok.is(tok::eof));
+  });
+
+  ModuleDeclaration *Mod = nullptr;
+  Lexer Lex(SrcMgr, Diags);
+  ASTContext ASTCtx(SrcMgr, Name);
+  Sema Actions(Diags, ASTCtx);
+  Parser Parser(Lex, Actions);
+  Parser.setSkipBodies(SkipBodies || BodyPool);
+  measure(Stats[ParsePhase], [&] { Mod = Parser.parse(); });
+  if (Mod && BodyPool)
+    measure(Stats[BodiesPhase], [&] {
+      Parser.parseSkippedBodies(Mod, *BodyPool);
+    });
+  else if (Mod && SkipBodies)
+    measure(Stats[BodiesPhase],
+            [&] { Parser.parseSkippedBodies(Mod); });
+  if (!Mod || Diags.numErrors()) {
+    WithColor::error() << Name << " does not compile\n";
+    return false;
+  }
+
+  llvm::LLVMContext Ctx;
+  std::unique_ptr<llvm::Module> M;
+  measure(Stats[CodeGenPhase], [&] {
+    std::unique_ptr<CodeGenerator> CG(
+        CodeGenerator::create(Ctx, ASTCtx, TM));
+    M = CG->run(Mod, Name.str());
+  });
+  if (llvm::verifyModule(*M, &errs())) {
+    WithColor::error()
+        << "Invalid IR generated for " << Name << "\n";
+    return false;
+  }
+
+  if (Backend) {
+    measure(Stats[BackendPhase], [&] {
+      llvm::SmallVector<char, 0> Object;
+      llvm::raw_svector_ostream OS(Object);
+      legacy::PassManager PM;
+      TM->addPassesToEmitFile(PM, OS, nullptr,
+                              CGFT_ObjectFile);
+      PM.run(*M);
+    });
+  }
+  return true;
+}
+
+void printStats(StringRef Name, StringRef Source,
+                const PhaseStats (&Stats)[NumPhases]) {
+  size_t Lines = std::count(Source.begin(), Source.end(),
+                            '\n');
+  outs() << Name << ": " << Lines << " lines, "
+         << Source.size() << " bytes\n";
+  outs() << "  phase                ms        lines/s"
+            "    bytes alloc       allocs\n";
+  for (unsigned P = 0; P != NumPhases; ++P) {
+    const PhaseStats &S = Stats[P];
+    if (!S.Ran)
+      continue;
+    outs() << format("  %-12s %10.3f %14.0f %14llu %12llu\n",
+                     PhaseNames[P], S.Seconds * 1000,
+                     S.Seconds > 0 ? Lines / S.Seconds : 0.0,
+                     (unsigned long long)S.Bytes,
+                     (unsigned long long)S.Allocations);
+  }
+}
+
+llvm::TargetMachine *createTargetMachine() {
+  std::string Triple = llvm::sys::getDefaultTargetTriple();
+  std::string Error;
+  const llvm::Target *Target =
+      llvm::TargetRegistry::lookupTarget(Triple, Error);
+  if (!Target) {
+    WithColor::error() << Error << "\n";
+    return nullptr;
+  }
+  return Target->createTargetMachine(
+      Triple, llvm::sys::getHostCPUName(), "",
+      llvm::TargetOptions(),
+      std::optional<llvm::Reloc::Model>());
+}
+} // namespace
+
+int main(int Argc, const char **Argv) {
+  llvm::InitLLVM X(Argc, Argv);
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  llvm::cl::ParseCommandLineOptions(Argc, Argv, Head);
+
+  WorkloadShape Shape;
+  Shape.Procedures = Procedures;
+  Shape.Statements = Statements;
+  Shape.NestingDepth = NestingDepth;
+  Shape.ExpressionDepth = ExpressionDepth;
+  Shape.Arrays = Arrays;
+  Shape.Records = Records;
+  Shape.Seed = Seed;
+
+  if (DumpWorkload) {
+    outs() << generateWorkload(Shape);
+    return EXIT_SUCCESS;
+  }
+
+  std::unique_ptr<llvm::TargetMachine> TM(
+      createTargetMachine());
+  if (!TM)
+    return EXIT_FAILURE;
+
+  // Inputs as (name, source) pairs.
+  std::vector<std::pair<std::string, std::string>> Inputs;
+  if (InputFiles.empty()) {
+    Inputs.emplace_back("<generated>",
+                        generateWorkload(Shape));
+  }
+  for (const auto &F : InputFiles) {
+    auto FileOrErr = llvm::MemoryBuffer::getFile(F);
+    if (std::error_code EC = FileOrErr.getError()) {
+      WithColor::error(errs(), Argv[0])
+          << "Error reading " << F << ": " << EC.message()
+          << "\n";
+      return EXIT_FAILURE;
+    }
+    Inputs.emplace_back(F, (*FileOrErr)->getBuffer().str());
+  }
+
+  std::unique_ptr<llvm::ThreadPool> BodyPool;
+  if (ParseThreads != 1)
+    BodyPool = std::make_unique<llvm::ThreadPool>(
+        llvm::hardware_concurrency(ParseThreads));
+
+  unsigned Runs = std::max(1u, unsigned(Iterations));
+  outs() << Head << " " << getTinylangVersion()
+         << ", best of " << Runs << " runs";
+  if (BodyPool)
+    outs() << ", bodies on " << BodyPool->getThreadCount()
+           << " threads";
+  outs() << "\n";
+  for (const auto &[Name, Source] : Inputs) {
+    PhaseStats Stats[NumPhases];
+    for (unsigned I = 0; I != Runs; ++I)
+      if (!compileOnce(Name, Source, TM.get(),
+                       BodyPool.get(), Stats))
+        return EXIT_FAILURE;
+    printStats(Name, Source, Stats);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+#include "WorkloadGenerator.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+
+using namespace tinylang;
+
+namespace {
+// Number of elements of the generated array type.
+constexpr unsigned ArraySize = 16;
+
+class WorkloadGenerator {
+  const WorkloadShape &Shape;
+  std::mt19937 Rng;
+  llvm::raw_string_ostream OS;
+  // Statements left to generate for the current procedure.
+  unsigned Remaining = 0;
+
+  unsigned random(unsigned N) { return Rng() % N; }
+
+  template <typename T, size_t N> T pick(T (&Choices)[N]) {
+    return Choices[random(N)];
+  }
+
+  void indent(unsigned Depth) { OS.indent(2 + 2 * Depth); }
+
+  // A variable, parameter or literal.
+  void emitLeaf() {
+    static const char *Vars[] = {"a", "b", "x", "y",
+                                 "z", "g0", "g1"};
+    if (random(4) == 0)
+      OS << 1 + random(999);
+    else
+      OS << pick(Vars);
+  }
+
+  // An INTEGER expression. The left operand always goes
+  // the full depth, the right one a random part of it.
+  void emitExpr(unsigned Depth, bool Parens = false) {
+    if (Depth == 0) {
+      emitLeaf();
+      return;
+    }
+    static const char *Ops[] = {"+", "-", "*", "DIV", "MOD"};
+    if (Parens)
+      OS << "(";
+    emitExpr(Depth - 1, true);
+    OS << " " << pick(Ops) << " ";
+    emitExpr(random(Depth), true);
+    if (Parens)
+      OS << ")";
+  }
+
+  void emitCondition() {
+    static const char *Relations[] = {"=", "#", "<",
+                                      "<=", ">", ">="};
+    unsigned Depth = Shape.ExpressionDepth;
+    emitExpr(random(Depth + 1), true);
+    OS << " " << pick(Relations) << " ";
+    emitExpr(random(Depth + 1), true);
+  }
+
+  // Assigns to a scalar, an array element or a record
+  // field. The code generator only tracks local aggregates
+  // in the entry block, so elements of the global ones are
+  // assigned here.
+  void emitAssignment(unsigned Depth) {
+    static const char *Scalars[] = {"x", "y", "z", "g0",
+                                    "g1"};
+    static const char *Fields[] = {"X", "Y"};
+    indent(Depth);
+    unsigned Kind = random(4);
+    if (Kind == 0 && Shape.Arrays)
+      OS << "gv["
+         << random(ArraySize) << "]";
+    else if (Kind == 1 && Shape.Records)
+      OS << "gr."
+         << pick(Fields);
+    else
+      OS << pick(Scalars);
+    OS << " := ";
+    emitExpr(Shape.ExpressionDepth);
+  }
+
+  void emitStatement(unsigned Depth) {
+    --Remaining;
+    // Compound statements need room for their bodies.
+    unsigned Kind = Depth < Shape.NestingDepth && Remaining
+                        ? random(4)
+                        : 0;
+    if (Kind == 1) {
+      indent(Depth);
+      OS << "IF ";
+      emitCondition();
+      OS << " THEN\n";
+      emitStatementSequence(Depth + 1);
+      if (Remaining && random(2)) {
+        OS << "\n";
+        indent(Depth);
+        OS << "ELSE\n";
+        emitStatementSequence(Depth + 1);
+      }
+      OS << "\n";
+      indent(Depth);
+      OS << "END";
+    } else if (Kind == 2) {
+      indent(Depth);
+      OS << "WHILE ";
+      emitCondition();
+      OS << " DO\n";
+      emitStatementSequence(Depth + 1);
+      OS << "\n";
+      indent(Depth);
+      OS << "END";
+    } else {
+      emitAssignment(Depth);
+    }
+  }
+
+  // At least one statement. Nested sequences end early at
+  // random so that statements are spread over the nesting
+  // levels.
+  void emitStatementSequence(unsigned Depth) {
+    emitStatement(Depth);
+    while (Remaining && (Depth == 0 || random(3))) {
+      OS << ";\n";
+      emitStatement(Depth);
+    }
+  }
+
+  void emitProcedure(unsigned Idx) {
+    std::string Name = ("P" + llvm::Twine(Idx)).str();
+    OS << "PROCEDURE " << Name
+       << "(a, b: INTEGER): INTEGER;\n"
+       << "VAR x, y, z: INTEGER;\n";
+    if (Shape.Arrays)
+      OS << "  v: Vec;\n";
+    if (Shape.Records)
+      OS << "  r: Pair;\n";
+    // Start with assignments: the code generator can not
+    // use the entry block as a loop header.
+    OS << "BEGIN\n";
+    if (Shape.Arrays)
+      OS << "  v[" << random(ArraySize) << "] := a;\n";
+    if (Shape.Records)
+      OS << "  r.X := b;\n";
+    OS << "  x := a;\n"
+       << "  y := b;\n"
+       << "  z := 0";
+    Remaining = Shape.Statements;
+    if (Remaining) {
+      OS << ";\n";
+      emitStatementSequence(0);
+    }
+    OS << ";\n"
+       << "  RETURN x + y + z\n"
+       << "END " << Name << ";\n\n";
+  }
+
+public:
+  WorkloadGenerator(const WorkloadShape &Shape,
+                    std::string &Buffer)
+      : Shape(Shape), Rng(Shape.Seed), OS(Buffer) {}
+
+  void run() {
+    OS << "MODULE Bench;\n\n";
+    if (Shape.Arrays || Shape.Records) {
+      OS << "TYPE\n";
+      if (Shape.Arrays)
+        OS << "  Vec = ARRAY [" << ArraySize
+           << "] OF INTEGER;\n";
+      if (Shape.Records)
+        OS << "  Pair = RECORD X, Y: INTEGER END;\n";
+      OS << "\n";
+    }
+    OS << "VAR g0, g1: INTEGER;\n";
+    if (Shape.Arrays)
+      OS << "  gv: Vec;\n";
+    if (Shape.Records)
+      OS << "  gr: Pair;\n";
+    OS << "\n";
+    for (unsigned I = 0; I != Shape.Procedures; ++I)
+      emitProcedure(I);
+    OS << "END Bench.\n";
+    OS.flush();
+  }
+};
+} // namespace
+
+std::string
+tinylang::generateWorkload(const WorkloadShape &Shape) {
+  std::string Source;
+  WorkloadGenerator(Shape, Source).run();
+  return Source;
+}
@@ -0,0 +1,35 @@
+#ifndef TINYLANG_TOOLS_BENCH_WORKLOADGENERATOR_H
+#define TINYLANG_TOOLS_BENCH_WORKLOADGENERATOR_H
+
+#include <string>
+
+namespace tinylang {
+
+/// Shape of a generated module.
+struct WorkloadShape {
+  /// Number of procedures in the module.
+  unsigned Procedures = 100;
+  /// Statements per procedure, counting the statements
+  /// nested in IF and WHILE bodies.
+  unsigned Statements = 20;
+  /// Maximum nesting of IF and WHILE statements.
+  unsigned NestingDepth = 2;
+  /// Maximum depth of an expression tree.
+  unsigned ExpressionDepth = 3;
+  /// Whether array and record variables are declared and
+  /// assigned to.
+  bool Arrays = true;
+  bool Records = true;
+  /// The same seed always generates the same module.
+  unsigned Seed = 1;
+};
+
+/// Generates the source of a module of the given shape.
+/// The module compiles without diagnostics, and only uses
+/// the constructs the code generator implements: there are
+/// no procedure calls, and array elements and record fields
+/// are written but never read.
+std::string generateWorkload(const WorkloadShape &Shape);
+
+} // namespace tinylang
+#endif
@@ -0,0 +1,101 @@
+#include "tinylang/Daemon/Protocol.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <vector>
+
+// tinylang-client takes the arguments of tinylang, and lets
+// a running daemon (tinylang -daemon) compile. Without a
+// daemon, it runs tinylang itself.
+
+using namespace llvm;
+using namespace tinylang;
+
+namespace {
+// Arguments the daemon can not handle: standard input,
+// response files, and options printing help or the version.
+bool needsLocalCompiler(ArrayRef<const char *> Args) {
+  for (StringRef Arg : Args)
+    if (Arg == "-" || Arg.startswith("@") ||
+        Arg.contains("help") || Arg == "-version" ||
+        Arg == "--version")
+      return true;
+  return false;
+}
+
+// Returns the exit code of the daemon compiling Args, or
+// nothing if there is no daemon.
+std::optional<int>
+compileInDaemon(ArrayRef<const char *> Args) {
+  int FD = daemon::connectTo(daemon::getSocketPath());
+  if (FD < 0)
+    return std::nullopt;
+  SmallString<128> WorkingDir;
+  if (sys::fs::current_path(WorkingDir)) {
+    daemon::closeSocket(FD);
+    return std::nullopt;
+  }
+  std::vector<std::string> Request{std::string(WorkingDir),
+                                   "tinylang"};
+  Request.insert(Request.end(), Args.begin(), Args.end());
+  std::vector<std::string> Response;
+  bool Done = daemon::sendStrings(FD, Request) &&
+              daemon::receiveStrings(FD, Response) &&
+              Response.size() == 2;
+  daemon::closeSocket(FD);
+  int ExitCode;
+  if (!Done ||
+      StringRef(Response[0]).getAsInteger(10, ExitCode))
+    return std::nullopt;
+  errs() << Response[1];
+  return ExitCode;
+}
+
+// Runs the tinylang next to this program, or the one in
+// the PATH.
+int compileLocally(const char *Argv0,
+                   ArrayRef<const char *> Args) {
+  static int Anchor;
+  SmallString<128> Compiler(sys::path::parent_path(
+      sys::fs::getMainExecutable(Argv0, &Anchor)));
+  sys::path::append(Compiler, "tinylang");
+  if (!sys::fs::can_execute(Compiler)) {
+    auto Found = sys::findProgramByName("tinylang");
+    if (!Found) {
+      WithColor::error(errs(), Argv0)
+          << "tinylang not found\n";
+      return EXIT_FAILURE;
+    }
+    Compiler = *Found;
+  }
+  std::vector<StringRef> CompilerArgs{Compiler};
+  CompilerArgs.insert(CompilerArgs.end(), Args.begin(),
+                      Args.end());
+  std::string Error;
+  int ExitCode = sys::ExecuteAndWait(
+      Compiler, CompilerArgs, /*Env=*/std::nullopt,
+      /*Redirects=*/{}, /*SecondsToWait=*/0,
+      /*MemoryLimit=*/0, &Error);
+  if (ExitCode < 0) {
+    WithColor::error(errs(), Argv0) << Error << '\n';
+    return EXIT_FAILURE;
+  }
+  return ExitCode;
+}
+} // namespace
+
+int main(int Argc, const char **Argv) {
+  InitLLVM X(Argc, Argv);
+  ArrayRef<const char *> Args(Argv + 1, Argc - 1);
+  if (!needsLocalCompiler(Args))
+    if (std::optional<int> ExitCode = compileInDaemon(Args))
+      return *ExitCode;
+  return compileLocally(Argv[0], Args);
+}
@@ -0,0 +1,153 @@
+#include "Driver.h"
+#include "tinylang/Daemon/Protocol.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/WithColor.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace llvm;
+using namespace tinylang;
+
+namespace {
+// Creating a target machine takes longer than compiling a
+// small module, so the daemon keeps those it created. A
+// target machine is not safe to use from several threads,
+// so each compilation takes one out of the pool, and
+// returns it when done.
+class TargetMachinePool {
+  std::mutex Mutex;
+  // Idle target machines by the target and code generation
+  // options they were created for (see getKey()).
+  StringMap<std::vector<std::unique_ptr<TargetMachine>>>
+      Idle;
+
+  // Only what the target machine is created from, so that
+  // builds with other paths or driver options share it.
+  static std::string getKey(const Invocation &Inv) {
+    std::string Key;
+    for (StringRef Part : {StringRef(Inv.Triple),
+                           StringRef(Inv.MArch),
+                           StringRef(Inv.CPU),
+                           StringRef(Inv.Features)})
+      Key.append(Part.str()).append(1, '\0');
+    Key += Inv.RelocModel
+               ? std::to_string(*Inv.RelocModel)
+               : std::string("default");
+    Key += Inv.CodeGenOptions;
+    return Key;
+  }
+
+public:
+  std::unique_ptr<TargetMachine> take(const Invocation &Inv,
+                                      raw_ostream &Errs) {
+    {
+      std::lock_guard<std::mutex> Guard(Mutex);
+      auto I = Idle.find(getKey(Inv));
+      if (I != Idle.end() && !I->second.empty()) {
+        std::unique_ptr<TargetMachine> TM =
+            std::move(I->second.back());
+        I->second.pop_back();
+        return TM;
+      }
+    }
+    return std::unique_ptr<TargetMachine>(
+        createTargetMachine(Inv, Errs));
+  }
+
+  void give(const Invocation &Inv,
+            std::unique_ptr<TargetMachine> TM) {
+    std::lock_guard<std::mutex> Guard(Mutex);
+    Idle[getKey(Inv)].push_back(std::move(TM));
+  }
+};
+
+// The output of the request handled by this thread, until
+// a fatal error was reported to it.
+thread_local raw_ostream *RequestErrs = nullptr;
+
+// A fatal error only ends the request causing it, not the
+// daemon.
+void handleFatalError(void *, const char *Reason, bool) {
+  raw_ostream &OS = RequestErrs ? *RequestErrs : errs();
+  OS << "LLVM ERROR: " << Reason << '\n';
+  RequestErrs = nullptr;
+  if (CrashRecoveryContext *CRC =
+          CrashRecoveryContext::GetCurrent())
+    CRC->HandleExit(1);
+}
+
+// Compiles the request of the client connected at FD, and
+// sends back the exit code and the output.
+void handleClient(int FD, TargetMachinePool &TMs) {
+  std::vector<std::string> Request;
+  if (!daemon::receiveStrings(FD, Request) ||
+      Request.size() < 2) {
+    daemon::closeSocket(FD);
+    return;
+  }
+  std::vector<const char *> Args;
+  for (const std::string &Arg :
+       ArrayRef<std::string>(Request).drop_front())
+    Args.push_back(Arg.c_str());
+
+  std::string Output;
+  raw_string_ostream Errs(Output);
+  int ExitCode = 1;
+  if (std::optional<Invocation> Inv =
+          parseInvocation(Args, Request[0], Errs)) {
+    if (std::unique_ptr<TargetMachine> TM =
+            TMs.take(*Inv, Errs)) {
+      RequestErrs = &Errs;
+      CrashRecoveryContext CRC;
+      if (CRC.RunSafely(
+              [&] { compile(*Inv, TM.get(), Errs); })) {
+        ExitCode = 0;
+        TMs.give(*Inv, std::move(TM));
+      } else {
+        // The target machine may be left in any state.
+        (void)TM.release();
+        if (RequestErrs)
+          WithColor::error(Errs, Inv->Argv0)
+              << "the compiler crashed\n";
+        ExitCode = CRC.RetCode ? CRC.RetCode : 1;
+      }
+      RequestErrs = nullptr;
+    }
+  }
+  Errs.flush();
+  daemon::sendStrings(FD,
+                      {std::to_string(ExitCode), Output});
+  daemon::closeSocket(FD);
+}
+} // namespace
+
+int tinylang::runDaemon(const char *Argv0,
+                        StringRef SocketPath,
+                        unsigned Threads) {
+  std::string Error;
+  int FD = daemon::listenAt(SocketPath, Error);
+  if (FD < 0) {
+    WithColor::error(errs(), Argv0)
+        << SocketPath << ": " << Error << '\n';
+    return EXIT_FAILURE;
+  }
+  CrashRecoveryContext::Enable();
+  install_fatal_error_handler(handleFatalError);
+
+  TargetMachinePool TMs;
+  ThreadPool Pool(hardware_concurrency(Threads));
+  for (;;) {
+    int Client = daemon::acceptClient(FD);
+    if (Client < 0) {
+      WithColor::error(errs(), Argv0)
+          << SocketPath << ": can not accept clients\n";
+      return EXIT_FAILURE;
+    }
+    Pool.async(
+        [Client, &TMs] { handleClient(Client, TMs); });
+  }
+}
@@ -1,7 +1,13 @@
+#include "Driver.h"
 #include "tinylang/Basic/Diagnostic.h"
 #include "tinylang/Basic/Version.h"
 #include "tinylang/CodeGen/CodeGenerator.h"
+#include "tinylang/Daemon/Protocol.h"
 #include "tinylang/Parser/Parser.h"
+#include "tinylang/Serialization/BuildRecord.h"
+#include "tinylang/Serialization/ModuleInterface.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -10,10 +16,17 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/WithColor.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/TargetParser/Host.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 
 using namespace llvm;
 using namespace tinylang;
@@ -33,8 +46,130 @@ static llvm::cl::opt<bool>
              llvm::cl::desc("Emit IR code instead of assembler"),
              llvm::cl::init(false));
 
+static llvm::cl::opt<bool> SkipBodies(
+    "skip-bodies",
+    llvm::cl::desc("Only check the declarations of each "
+                   "module, skipping procedure bodies; no "
+                   "code is generated"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> ParseThreads(
+    "parse-threads",
+    llvm::cl::desc("Number of threads parsing procedure "
+                   "bodies after the declarations of a "
+                   "module (0 = one per core)"),
+    llvm::cl::init(1));
+
+static llvm::cl::list<std::string> ImportPaths(
+    "I",
+    llvm::cl::desc("Search directory for the interfaces of "
+                   "imported modules"),
+    llvm::cl::value_desc("directory"), llvm::cl::Prefix);
+
+static llvm::cl::opt<std::string> ModuleDir(
+    "module-dir",
+    llvm::cl::desc("Directory the interface of each "
+                   "compiled module is written to; it is "
+                   "searched before the -I directories"),
+    llvm::cl::value_desc("directory"), llvm::cl::init("."));
+
+static llvm::cl::opt<bool> Incremental(
+    "incremental",
+    llvm::cl::desc("Compile the modules in the order of "
+                   "their imports, skipping those whose "
+                   "source, options and imported interfaces "
+                   "did not change since the last build"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<DiagnosticFormat> DiagFormat(
+    "fdiagnostics-format",
+    llvm::cl::desc("Format of the diagnostics"),
+    llvm::cl::values(
+        clEnumValN(DiagnosticFormat::Text, "text",
+                   "Text with the source line (default)"),
+        clEnumValN(DiagnosticFormat::JSON, "json",
+                   "One JSON object per line"),
+        clEnumValN(DiagnosticFormat::SARIF, "sarif",
+                   "A SARIF 2.1.0 log")),
+    llvm::cl::init(DiagnosticFormat::Text));
+
+static llvm::cl::opt<unsigned> ErrorLimit(
+    "ferror-limit",
+    llvm::cl::desc("Stop compiling a module after this "
+                   "many errors (0 = no limit)"),
+    llvm::cl::init(20));
+
+static llvm::cl::opt<bool> Daemon(
+    "daemon",
+    llvm::cl::desc("Run as a daemon, compiling the "
+                   "requests of tinylang-client"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> DaemonSocket(
+    "daemon-socket",
+    llvm::cl::desc("Socket the daemon listens at (default: "
+                   "$TINYLANG_DAEMON_SOCKET, or one in the "
+                   "temporary directory)"),
+    llvm::cl::value_desc("path"));
+
+static llvm::cl::opt<unsigned> DaemonThreads(
+    "daemon-threads",
+    llvm::cl::desc("Number of requests the daemon compiles "
+                   "at once (0 = one per core)"),
+    llvm::cl::init(0));
+
 static const char *Head = "tinylang - Tinylang compiler";
 
+// The options of the driver itself; the target machine only
+// depends on the others.
+static llvm::cl::Option *const DriverOptions[] = {
+    &MTriple,      &EmitLLVM,     &SkipBodies,
+    &ParseThreads, &ModuleDir,    &Incremental,
+    &DiagFormat,   &ErrorLimit,   &Daemon,
+    &DaemonSocket, &DaemonThreads,
+    // Its & yields the list of values.
+    std::addressof(ImportPaths)};
+
+// Returns the arguments in Args which are neither inputs
+// nor driver options, nor the values of those.
+static std::string
+getCodeGenOptions(ArrayRef<const char *> Args,
+                  const llvm::StringSet<> &Inputs) {
+  std::string Result;
+  for (size_t I = 0, E = Args.size(); I != E; ++I) {
+    StringRef Arg = Args[I];
+    if (Inputs.count(Arg))
+      continue;
+    if (Arg.startswith("-")) {
+      StringRef Name = Arg.ltrim('-');
+      StringRef Key = Name.split('=').first;
+      const llvm::cl::Option *Driver = nullptr;
+      bool HasValue = Name.contains('=');
+      for (const llvm::cl::Option *O : DriverOptions) {
+        if (O->ArgStr == Key) {
+          Driver = O;
+          break;
+        }
+        // E.g. -Idir.
+        if (O->getFormattingFlag() == llvm::cl::Prefix &&
+            Key.startswith(O->ArgStr)) {
+          Driver = O;
+          HasValue = true;
+          break;
+        }
+      }
+      if (Driver) {
+        if (!HasValue && Driver->getValueExpectedFlag() ==
+                             llvm::cl::ValueRequired)
+          ++I;
+        continue;
+      }
+    }
+    Result.append(1, '\0').append(Arg.str());
+  }
+  return Result;
+}
+
 void printVersion(llvm::raw_ostream &OS) {
   OS << Head << " " << getTinylangVersion() << "\n";
   OS << "  Default target: "
@@ -48,59 +183,130 @@ void printVersion(llvm::raw_ostream &OS) {
   exit(EXIT_SUCCESS);
 }
 
-llvm::TargetMachine *
-createTargetMachine(const char *Argv0) {
+std::string Invocation::resolve(StringRef Path) const {
+  if (WorkingDir.empty() || Path == "-" ||
+      llvm::sys::path::is_absolute(Path))
+    return Path.str();
+  llvm::SmallString<128> Resolved(WorkingDir);
+  llvm::sys::path::append(Resolved, Path);
+  return std::string(Resolved);
+}
+
+// Copies the settings from the options, which must be
+// parsed from Args already.
+Invocation getInvocation(ArrayRef<const char *> Args,
+                         StringRef WorkingDir) {
+  Invocation Inv;
+  Inv.Argv0 = Args[0];
+  Inv.WorkingDir = WorkingDir.str();
+  Inv.InputFiles.assign(InputFiles.begin(),
+                        InputFiles.end());
+  llvm::StringSet<> Inputs;
+  for (const std::string &F : InputFiles)
+    Inputs.insert(F);
+  for (const char *Arg : Args.drop_front())
+    if (!Inputs.count(Arg))
+      Inv.Options.append(1, '\0').append(Arg);
+  Inv.CodeGenOptions =
+      getCodeGenOptions(Args.drop_front(), Inputs);
+
   llvm::Triple Triple = llvm::Triple(
       !MTriple.empty()
           ? llvm::Triple::normalize(MTriple)
           : llvm::sys::getDefaultTargetTriple());
-
-  llvm::TargetOptions TargetOptions =
+  Inv.Triple = Triple.getTriple();
+  Inv.MArch = codegen::getMArch();
+  Inv.CPU = codegen::getCPUStr();
+  Inv.Features = codegen::getFeaturesStr();
+  Inv.TargetOptions =
       codegen::InitTargetOptionsFromCodeGenFlags(Triple);
-  std::string CPUStr = codegen::getCPUStr();
-  std::string FeatureStr = codegen::getFeaturesStr();
+  Inv.RelocModel =
+      std::optional<llvm::Reloc::Model>(codegen::getRelocModel());
+  Inv.FileType = codegen::getFileType();
 
+  Inv.EmitLLVM = EmitLLVM;
+  Inv.SkipBodies = SkipBodies;
+  Inv.ParseThreads = ParseThreads;
+  Inv.Incremental = Incremental;
+  Inv.ModuleDir = Inv.resolve(ModuleDir);
+  Inv.SearchPath.push_back(Inv.ModuleDir);
+  for (const std::string &Dir : ImportPaths)
+    Inv.SearchPath.push_back(Inv.resolve(Dir));
+  Inv.DiagFormat = DiagFormat;
+  Inv.ErrorLimit = ErrorLimit;
+  return Inv;
+}
+
+std::optional<Invocation>
+tinylang::parseInvocation(ArrayRef<const char *> Args,
+                          StringRef WorkingDir,
+                          raw_ostream &Errs) {
+  // The options are global, so only one thread at a time
+  // can parse and copy them.
+  static std::mutex OptionsMutex;
+  std::lock_guard<std::mutex> Guard(OptionsMutex);
+  llvm::cl::ResetAllOptionOccurrences();
+  if (!llvm::cl::ParseCommandLineOptions(
+          Args.size(), Args.data(), Head, &Errs))
+    return std::nullopt;
+  if (Daemon) {
+    WithColor::error(Errs, Args[0])
+        << "a daemon can not be started by a client\n";
+    return std::nullopt;
+  }
+  return getInvocation(Args, WorkingDir);
+}
+
+llvm::TargetMachine *
+tinylang::createTargetMachine(const Invocation &Inv,
+                              raw_ostream &Errs) {
+  llvm::Triple Triple(Inv.Triple);
   std::string Error;
   const llvm::Target *Target =
-      llvm::TargetRegistry::lookupTarget(codegen::getMArch(), Triple,
+      llvm::TargetRegistry::lookupTarget(Inv.MArch, Triple,
                                          Error);
 
   if (!Target) {
-    llvm::WithColor::error(llvm::errs(), Argv0) << Error;
+    llvm::WithColor::error(Errs, Inv.Argv0) << Error;
     return nullptr;
   }
 
   llvm::TargetMachine *TM = Target->createTargetMachine(
-      Triple.getTriple(), CPUStr, FeatureStr, TargetOptions,
-      std::optional<llvm::Reloc::Model>(codegen::getRelocModel()));
+      Triple.getTriple(), Inv.CPU, Inv.Features,
+      Inv.TargetOptions, Inv.RelocModel);
   return TM;
 }
 
-bool emit(StringRef Argv0, llvm::Module *M,
-          llvm::TargetMachine *TM,
-          StringRef InputFilename) {
-  CodeGenFileType FileType = codegen::getFileType();
+std::string getOutputFilename(const Invocation &Inv,
+                              StringRef InputFilename) {
+  if (InputFilename == "-")
+    return "-";
   std::string OutputFilename;
-  if (InputFilename == "-") {
-    OutputFilename = "-";
-  } else {
-    if (InputFilename.endswith(".mod") ||
-        InputFilename.endswith(".mod"))
-      OutputFilename = InputFilename.drop_back(4).str();
-    else
-      OutputFilename = InputFilename.str();
-    switch (FileType) {
-    case CGFT_AssemblyFile:
-      OutputFilename.append(EmitLLVM ? ".ll" : ".s");
-      break;
-    case CGFT_ObjectFile:
-      OutputFilename.append(".o");
-      break;
-    case CGFT_Null:
-      OutputFilename.append(".null");
-      break;
-    }
+  if (InputFilename.endswith(".mod") ||
+      InputFilename.endswith(".mod"))
+    OutputFilename = InputFilename.drop_back(4).str();
+  else
+    OutputFilename = InputFilename.str();
+  switch (Inv.FileType) {
+  case CGFT_AssemblyFile:
+    OutputFilename.append(Inv.EmitLLVM ? ".ll" : ".s");
+    break;
+  case CGFT_ObjectFile:
+    OutputFilename.append(".o");
+    break;
+  case CGFT_Null:
+    OutputFilename.append(".null");
+    break;
   }
+  return Inv.resolve(OutputFilename);
+}
+
+bool emit(const Invocation &Inv, llvm::Module *M,
+          llvm::TargetMachine *TM, StringRef InputFilename,
+          raw_ostream &Errs) {
+  CodeGenFileType FileType = Inv.FileType;
+  std::string OutputFilename =
+      getOutputFilename(Inv, InputFilename);
 
   // Open the file.
   std::error_code EC;
@@ -110,17 +316,17 @@ bool emit(StringRef Argv0, llvm::Module *M,
   auto Out = std::make_unique<llvm::ToolOutputFile>(
       OutputFilename, EC, OpenFlags);
   if (EC) {
-    WithColor::error(llvm::errs(), Argv0) << EC.message() << '\n';
+    WithColor::error(Errs, Inv.Argv0) << EC.message() << '\n';
     return false;
   }
 
-  if (FileType == CGFT_AssemblyFile && EmitLLVM) {
+  if (FileType == CGFT_AssemblyFile && Inv.EmitLLVM) {
     M->print(Out->os(), nullptr);
   } else {
     legacy::PassManager PM;
     if (TM->addPassesToEmitFile(PM, Out->os(), nullptr,
                                 FileType)) {
-      WithColor::error()
+      WithColor::error(Errs)
           << "No support for file type\n";
       return false;
     }
@@ -130,6 +336,280 @@ bool emit(StringRef Argv0, llvm::Module *M,
   return true;
 }
 
+// Writes <module name>.tli to the module directory, for
+// other modules to import. An unchanged interface is not
+// written again, so its time stamp only changes with the
+// interface. Returns the hash of the interface, or nothing
+// on error.
+std::optional<uint64_t>
+writeInterface(const Invocation &Inv, ModuleDeclaration *Mod,
+               raw_ostream &Errs) {
+  llvm::SmallString<128> Path(Inv.ModuleDir);
+  llvm::sys::path::append(Path, Mod->getName() +
+                                    ModuleInterfaceExtension);
+  std::string Contents;
+  {
+    llvm::raw_string_ostream OS(Contents);
+    writeModuleInterface(Mod, OS);
+  }
+  uint64_t Hash = hashModuleInterface(Contents);
+  auto Old = llvm::MemoryBuffer::getFile(
+      Path, /*IsText=*/false,
+      /*RequiresNullTerminator=*/false);
+  if (Old && (*Old)->getBuffer() == Contents)
+    return Hash;
+
+  // Written to a temporary file and renamed, so a concurrent
+  // compilation importing the module never reads half an
+  // interface, and one that has the old file open keeps it.
+  if (Error Err = llvm::writeToOutput(
+          Path, [&](raw_ostream &OS) {
+            OS << Contents;
+            return Error::success();
+          })) {
+    WithColor::error(Errs, Inv.Argv0)
+        << toString(std::move(Err)) << '\n';
+    return std::nullopt;
+  }
+  return Hash;
+}
+
+// Hash of the interface of module Name found in
+// SearchPath, or nothing if there is none.
+std::optional<uint64_t>
+getInterfaceHash(llvm::ArrayRef<std::string> SearchPath,
+                 StringRef Name) {
+  std::string Path = findModuleInterface(SearchPath, Name);
+  if (Path.empty())
+    return std::nullopt;
+  auto Buffer = llvm::MemoryBuffer::getFile(
+      Path, /*IsText=*/false,
+      /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return std::nullopt;
+  return hashModuleInterface((*Buffer)->getBuffer());
+}
+
+// Hash of everything besides the sources that affects the
+// output: the compiler version and the options.
+uint64_t getOptionsHash(const Invocation &Inv) {
+  return llvm::xxHash64(getTinylangVersion() + Inv.Options);
+}
+
+// A module is up to date if it was compiled from the same
+// source with the same options, its output and interface
+// are still there, and the interfaces it imported did not
+// change.
+bool isUpToDate(const Invocation &Inv,
+                const BuildRecord &Rec,
+                StringRef InputFilename, uint64_t SourceHash,
+                uint64_t OptionsHash) {
+  if (Rec.SourceHash != SourceHash ||
+      Rec.OptionsHash != OptionsHash)
+    return false;
+  if (!Inv.SkipBodies &&
+      !sys::fs::exists(getOutputFilename(Inv, InputFilename)))
+    return false;
+  if (getInterfaceHash(Inv.ModuleDir, Rec.ModuleName) !=
+      Rec.InterfaceHash)
+    return false;
+  for (const auto &[Name, Hash] : Rec.Imports)
+    if (getInterfaceHash(Inv.SearchPath, Name) != Hash)
+      return false;
+  return true;
+}
+
+// Returns the input files ordered so that each module
+// comes after the modules it imports, as far as they are
+// among the inputs. The imports are found by lexing the
+// head of each file; files which can not be read, and
+// cyclic imports, are left for the compiler to report.
+std::vector<std::string>
+orderByImports(const Invocation &Inv) {
+  const std::vector<std::string> &InputFiles =
+      Inv.InputFiles;
+  struct Input {
+    std::string Module;
+    std::vector<std::string> Imports;
+  };
+  std::vector<Input> Inputs(InputFiles.size());
+  llvm::StringMap<unsigned> ModuleToInput;
+  for (unsigned I = 0, E = InputFiles.size(); I != E; ++I) {
+    auto FileOrErr = llvm::MemoryBuffer::getFile(
+        Inv.resolve(InputFiles[I]));
+    if (!FileOrErr)
+      continue;
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr);
+    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr),
+                              llvm::SMLoc());
+    Lexer Lex(SrcMgr, Diags);
+    Lex.setReportErrors(false);
+    Token Tok;
+    Lex.next(Tok);
+    if (!Tok.is(tok::kw_MODULE))
+      continue;
+    Lex.next(Tok);
+    if (!Tok.is(tok::identifier))
+      continue;
+    Inputs[I].Module = Tok.getIdentifier().str();
+    ModuleToInput.try_emplace(Inputs[I].Module, I);
+    // Both FROM X IMPORT a, b and IMPORT X, Y end at a
+    // semicolon.
+    Lex.next(Tok);
+    Lex.next(Tok);
+    while (Tok.isOneOf(tok::kw_FROM, tok::kw_IMPORT)) {
+      bool From = Tok.is(tok::kw_FROM);
+      bool Names = !From;
+      Lex.next(Tok);
+      while (!Tok.isOneOf(tok::semi, tok::eof)) {
+        if (Tok.is(tok::kw_IMPORT))
+          Names = false;
+        else if (Tok.is(tok::identifier) &&
+                 (From || Names))
+          Inputs[I].Imports.push_back(
+              Tok.getIdentifier().str());
+        From = false;
+        Lex.next(Tok);
+      }
+      Lex.next(Tok);
+    }
+  }
+
+  enum { Unvisited, Visiting, Visited };
+  std::vector<int> State(Inputs.size(), Unvisited);
+  std::vector<std::string> Order;
+  std::function<void(unsigned)> Visit = [&](unsigned I) {
+    if (State[I] != Unvisited)
+      return;
+    State[I] = Visiting;
+    for (const std::string &Import : Inputs[I].Imports) {
+      auto It = ModuleToInput.find(Import);
+      if (It != ModuleToInput.end())
+        Visit(It->second);
+    }
+    State[I] = Visited;
+    Order.push_back(InputFiles[I]);
+  };
+  for (unsigned I = 0, E = Inputs.size(); I != E; ++I)
+    Visit(I);
+  return Order;
+}
+
+void tinylang::compile(const Invocation &Inv,
+                       llvm::TargetMachine *TM,
+                       raw_ostream &Errs) {
+  // With a single thread, bodies are parsed in place.
+  std::unique_ptr<llvm::ThreadPool> BodyPool;
+  if (Inv.ParseThreads != 1 && !Inv.SkipBodies)
+    BodyPool = std::make_unique<llvm::ThreadPool>(
+        llvm::hardware_concurrency(Inv.ParseThreads));
+
+  std::vector<std::string> Files =
+      Inv.Incremental ? orderByImports(Inv) : Inv.InputFiles;
+  uint64_t OptionsHash =
+      Inv.Incremental ? getOptionsHash(Inv) : 0;
+  // One printer for all modules, so that a SARIF log
+  // covers them all.
+  std::unique_ptr<DiagnosticConsumer> DiagPrinter =
+      createDiagnosticPrinter(Inv.DiagFormat, Errs);
+  // llvm::errs() is unbuffered, which costs a system call
+  // per diagnostic. The output for a file is buffered and
+  // written once the file is done.
+  bool WasUnbuffered = !Errs.GetBufferSize();
+  if (WasUnbuffered)
+    Errs.SetBufferSize(64 * 1024);
+
+  for (const auto &F : Files) {
+    auto FlushErrs =
+        llvm::make_scope_exit([&Errs] { Errs.flush(); });
+    std::string Path = Inv.resolve(F);
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+        FileOrErr = llvm::MemoryBuffer::getFile(Path);
+    if (std::error_code BufferError =
+            FileOrErr.getError()) {
+      llvm::WithColor::error(Errs, Inv.Argv0)
+          << "Error reading " << F << ": "
+          << BufferError.message() << "\n";
+      continue;
+    }
+    // Diagnostics name the file as given.
+    if (Path != F)
+      FileOrErr = llvm::MemoryBuffer::getMemBufferCopy(
+          (*FileOrErr)->getBuffer(), F);
+
+    // The record is removed while the module is compiled,
+    // so that it is compiled again if this fails.
+    std::string RecordPath;
+    BuildRecord Rec;
+    if (Inv.Incremental && F != "-") {
+      RecordPath =
+          getOutputFilename(Inv, F) + BuildRecordExtension;
+      Rec.SourceHash =
+          llvm::xxHash64((*FileOrErr)->getBuffer());
+      Rec.OptionsHash = OptionsHash;
+      std::optional<BuildRecord> Old =
+          BuildRecord::read(RecordPath);
+      if (Old && isUpToDate(Inv, *Old, F, Rec.SourceHash,
+                            OptionsHash))
+        continue;
+      sys::fs::remove(RecordPath);
+    }
+
+    llvm::SourceMgr SrcMgr;
+    DiagnosticsEngine Diags(SrcMgr, *DiagPrinter);
+    Diags.setErrorLimit(Inv.ErrorLimit);
+
+    // Tell SrcMgr about this buffer, which is what the
+    // parser will pick up.
+    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr),
+                              llvm::SMLoc());
+
+    auto TheLexer = Lexer(SrcMgr, Diags);
+    auto ASTCtx = ASTContext(SrcMgr, F);
+    auto TheSema = Sema(Diags, ASTCtx);
+    auto Loader = ModuleInterfaceLoader(Diags, TheSema,
+                                        Inv.SearchPath);
+    TheSema.setModuleLoader(&Loader);
+    auto TheParser = Parser(TheLexer, TheSema);
+    TheParser.setSkipBodies(Inv.SkipBodies || BodyPool);
+    auto *Mod = TheParser.parse();
+    if (Mod && BodyPool)
+      TheParser.parseSkippedBodies(Mod, *BodyPool);
+    if (!Mod || Diags.numErrors())
+      continue;
+    // The interface only needs the declarations, so it is
+    // written with -skip-bodies, too.
+    std::optional<uint64_t> InterfaceHash =
+        writeInterface(Inv, Mod, Errs);
+    bool Emitted = Inv.SkipBodies;
+    if (!Inv.SkipBodies) {
+      llvm::LLVMContext Ctx;
+      if (CodeGenerator *CG =
+              CodeGenerator::create(Ctx, ASTCtx, TM)) {
+        std::unique_ptr<llvm::Module> M = CG->run(Mod, F);
+        Emitted = emit(Inv, M.get(), TM, F, Errs);
+        if (!Emitted) {
+          llvm::WithColor::error(Errs, Inv.Argv0)
+              << "Error writing output\n";
+        }
+        delete CG;
+      }
+    }
+    if (!RecordPath.empty() && InterfaceHash && Emitted) {
+      Rec.ModuleName = Mod->getName().str();
+      Rec.InterfaceHash = *InterfaceHash;
+      Rec.Imports = Loader.getLoadedInterfaces();
+      if (!Rec.write(RecordPath))
+        llvm::WithColor::error(Errs, Inv.Argv0)
+            << "Error writing " << RecordPath << "\n";
+    }
+  }
+  DiagPrinter->finish();
+  if (WasUnbuffered)
+    Errs.SetUnbuffered();
+}
+
 int main(int Argc, const char **Argv) {
   llvm::InitLLVM X(Argc, Argv);
 
@@ -164,44 +644,18 @@ int main(int Argc, const char **Argv) {
     exit(EXIT_SUCCESS);
   }
 
-  llvm::TargetMachine *TM = createTargetMachine(Argv[0]);
+  if (Daemon)
+    return runDaemon(Argv[0],
+                     DaemonSocket.empty()
+                         ? daemon::getSocketPath()
+                         : DaemonSocket.getValue(),
+                     DaemonThreads);
+
+  Invocation Inv =
+      getInvocation(ArrayRef<const char *>(Argv, Argc), "");
+  llvm::TargetMachine *TM =
+      createTargetMachine(Inv, llvm::errs());
   if (!TM)
     exit(EXIT_FAILURE);
-
-  for (const auto &F : InputFiles) {
-    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
-        FileOrErr = llvm::MemoryBuffer::getFile(F);
-    if (std::error_code BufferError =
-            FileOrErr.getError()) {
-      llvm::WithColor::error(llvm::errs(), Argv[0])
-          << "Error reading " << F << ": "
-          << BufferError.message() << "\n";
-    }
-
-    llvm::SourceMgr SrcMgr;
-    DiagnosticsEngine Diags(SrcMgr);
-
-    // Tell SrcMgr about this buffer, which is what the
-    // parser will pick up.
-    SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr),
-                              llvm::SMLoc());
-
-    auto TheLexer = Lexer(SrcMgr, Diags);
-    auto ASTCtx = ASTContext(SrcMgr, F);
-    auto TheSema = Sema(Diags);
-    auto TheParser = Parser(TheLexer, TheSema);
-    auto *Mod = TheParser.parse();
-    if (Mod && !Diags.numErrors()) {
-      llvm::LLVMContext Ctx;
-      if (CodeGenerator *CG =
-              CodeGenerator::create(Ctx, ASTCtx, TM)) {
-        std::unique_ptr<llvm::Module> M = CG->run(Mod, F);
-        if (!emit(Argv[0], M.get(), TM, F)) {
-          llvm::WithColor::error(errs(), Argv[0])
-              << "Error writing output\n";
-        }
-        delete CG;
-      }
-    }
-  }
+  compile(Inv, TM, llvm::errs());
 }
@@ -0,0 +1,80 @@
+#ifndef TINYLANG_TOOLS_DRIVER_DRIVER_H
+#define TINYLANG_TOOLS_DRIVER_DRIVER_H
+
+#include "tinylang/Basic/DiagnosticPrinter.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+
+/// The settings of one compilation, copied from the
+/// command line options. The daemon runs several
+/// compilations at once, while there is only one set of
+/// options.
+struct Invocation {
+  std::string Argv0;
+  /// Relative paths are resolved against this directory,
+  /// unless it is empty.
+  std::string WorkingDir;
+  std::vector<std::string> InputFiles;
+  /// The arguments besides the input files.
+  std::string Options;
+  /// The arguments which are not input files or options of
+  /// the driver itself, i.e. the code generation flags.
+  std::string CodeGenOptions;
+
+  std::string Triple;
+  std::string MArch;
+  std::string CPU;
+  std::string Features;
+  llvm::TargetOptions TargetOptions;
+  std::optional<llvm::Reloc::Model> RelocModel;
+  llvm::CodeGenFileType FileType;
+
+  bool EmitLLVM;
+  bool SkipBodies;
+  unsigned ParseThreads;
+  bool Incremental;
+  /// Resolved already, like the search path.
+  std::string ModuleDir;
+  std::vector<std::string> SearchPath;
+  DiagnosticFormat DiagFormat;
+  unsigned ErrorLimit;
+
+  std::string resolve(llvm::StringRef Path) const;
+};
+
+/// Parses the command line Args of a compilation in
+/// WorkingDir. Returns nothing after printing the errors to
+/// Errs. This may be called from several threads.
+std::optional<Invocation>
+parseInvocation(llvm::ArrayRef<const char *> Args,
+                llvm::StringRef WorkingDir,
+                llvm::raw_ostream &Errs);
+
+llvm::TargetMachine *
+createTargetMachine(const Invocation &Inv,
+                    llvm::raw_ostream &Errs);
+
+/// Compiles the input files of Inv for TM, printing
+/// diagnostics to Errs.
+void compile(const Invocation &Inv,
+             llvm::TargetMachine *TM,
+             llvm::raw_ostream &Errs);
+
+/// Compiles the requests of clients connecting to
+/// SocketPath, Threads (0 = one per core) at a time, until
+/// the process is killed. Returns the exit code if the
+/// daemon can not start.
+int runDaemon(const char *Argv0, llvm::StringRef SocketPath,
+              unsigned Threads);
+
+} // namespace tinylang
+#endif
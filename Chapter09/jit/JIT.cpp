@@ -1,38 +1,115 @@
 #include "JIT.h"
+#include "PerfMapListener.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
 
 using namespace llvm;
 
-static cl::opt<std::string>
-      InputFile(cl::Positional, cl::Required, cl::desc("<input-file>"));
+static cl::list<std::string>
+      InputFiles(cl::Positional, cl::OneOrMore, cl::desc("<input-files>"));
+
+static cl::opt<unsigned>
+      NumThreads("num-threads",
+                 cl::desc("Number of materialization threads (0 = a thread per "
+                          "task, as ORC does by default); "
+                          "input files are parsed on this many threads, or "
+                          "on all cores if 0"),
+                 cl::init(0));
+
+static cl::opt<bool>
+      LazyCompile("lazy", cl::desc("Compile function bodies on first call"),
+                  cl::init(false));
+
+static cl::opt<bool>
+      PerfEvents("perf-events",
+                 cl::desc("Register the perf JIT event listener (jitdump)"),
+                 cl::init(false));
+
+static cl::opt<bool>
+      PerfMap("perf-map", cl::desc("Write JIT'd symbols to /tmp/perf-<pid>.map"),
+              cl::init(false));
+
+static cl::opt<bool>
+      GDBEvents("gdb-events",
+                cl::desc("Register JIT'd objects with the gdb JIT interface"),
+                cl::init(false));
+
+// Each file gets its own context, so files can be parsed concurrently and
+// the resulting modules compiled in parallel. Bitcode is loaded lazily: only
+// the globals are read here and function bodies are deserialized when the JIT
+// first needs them. Textual IR is parsed in full.
+orc::ThreadSafeModule loadModule(StringRef FileName, SMDiagnostic &Err) {
 
-std::unique_ptr<Module> loadModule(StringRef FileName, LLVMContext &Ctx, const char *ProgName) {
+    auto Ctx = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> Mod = getLazyIRFileModule(FileName, Err, *Ctx);
+    if(!Mod)
+        return orc::ThreadSafeModule();
 
-    SMDiagnostic Err;
-    std::unique_ptr<Module> Mod = parseIRFile(FileName, Err, Ctx);
-    if(!Mod.get()){
-        Err.print(ProgName, errs());
-        exit(-1);
+    return orc::ThreadSafeModule(std::move(Mod), std::move(Ctx));
+}      
+
+std::vector<orc::ThreadSafeModule> loadModules(const char *ProgName) {
+
+    std::vector<orc::ThreadSafeModule> Modules(InputFiles.size());
+    std::vector<SMDiagnostic> Errs(InputFiles.size());
+    {
+        ThreadPool Pool(hardware_concurrency(NumThreads));
+        for(size_t I = 0, E = InputFiles.size(); I != E; ++I)
+            Pool.async([&, I]() { Modules[I] = loadModule(InputFiles[I], Errs[I]); });
+        Pool.wait();
     }
 
-    return Mod;
-}      
+    // Report in command line order rather than in completion order.
+    bool HasError = false;
+    for(size_t I = 0, E = Modules.size(); I != E; ++I) {
+        if(!Modules[I].getModuleUnlocked()) {
+            Errs[I].print(ProgName, errs());
+            HasError = true;
+        }
+    }
+    if(HasError)
+        exit(-1);
+
+    return Modules;
+}
 
 
-Error jitmain(std::unique_ptr<Module> M,
-              std::unique_ptr<LLVMContext> Ctx,
+Error jitmain(std::vector<orc::ThreadSafeModule> Modules,
               int argc, char *argv[]) {
 
-      auto JIT = JIT::create();
+      // Declared before the JIT so it outlives the objects it is told about.
+      std::unique_ptr<PerfMapListener> PerfMapL;
+
+      auto JIT = JIT::create(NumThreads, LazyCompile);
       if(!JIT) 
         return JIT.takeError();
 
-      if(auto Err = (*JIT)->addIRModule(orc::ThreadSafeModule(std::move(M),
-                                                              std::move(Ctx))))
-        return Err;            
+      // Nothing is registered unless asked for, so the default path pays
+      // nothing for profiling support.
+      auto &ObjLayer = (*JIT)->getObjLinkingLayer();
+      if(PerfEvents) {
+        if(auto *L = JITEventListener::createPerfJITEventListener())
+          ObjLayer.registerJITEventListener(*L);
+        else
+          errs() << "warning: LLVM was built without perf support\n";
+      }
+      if(PerfMap) {
+        PerfMapL = std::make_unique<PerfMapListener>();
+        ObjLayer.registerJITEventListener(*PerfMapL);
+      }
+      if(GDBEvents) {
+        // Keep the debug sections around for the debugger.
+        ObjLayer.setProcessAllSections(true);
+        ObjLayer.registerJITEventListener(
+            *JITEventListener::createGDBRegistrationListener());
+      }
+
+      for(auto &TSM : Modules)
+        if(auto Err = (*JIT)->addIRModule(std::move(TSM)))
+          return Err;            
 
       auto MainSym = (*JIT)->lookup("main");
       if(!MainSym)
@@ -55,13 +132,11 @@ int main(int argc, char *argv[]) {
 
     cl::ParseCommandLineOptions(argc, argv, "jitty\n");
 
-    auto Ctx = std::make_unique<LLVMContext>();
-
-    std::unique_ptr<Module> M = loadModule(InputFile, *Ctx, argv[0]);
+    std::vector<orc::ThreadSafeModule> Modules = loadModules(argv[0]);
 
     ExitOnError ExitOnErr(std::string(argv[0]) + ": ");
 
-    ExitOnErr(jitmain(std::move(M), std::move(Ctx), argc, argv));
+    ExitOnErr(jitmain(std::move(Modules), argc, argv));
 
     return 0;
 }
@@ -3,18 +3,47 @@
 
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
 #include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
+#include "llvm/ExecutionEngine/Orc/TaskDispatch.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/Error.h"
+#include "SymbolCache.h"
+#include "llvm/Support/ThreadPool.h"
+#include <mutex>
+
+// Runs materialization tasks (optimization, compilation, linking) on a fixed
+// number of worker threads instead of starting a thread per task.
+class ThreadPoolTaskDispatcher : public llvm::orc::TaskDispatcher {
+
+    llvm::ThreadPool Pool;
+
+public:
+    explicit ThreadPoolTaskDispatcher(unsigned NumThreads)
+        : Pool(llvm::hardware_concurrency(NumThreads)) {}
+
+    void dispatch(std::unique_ptr<llvm::orc::Task> T) override {
+        // ThreadPool only accepts copyable callables, so the task is passed
+        // as a raw pointer and re-owned on the worker thread.
+        Pool.async([UnownedT = T.release()]() {
+            std::unique_ptr<llvm::orc::Task> T(UnownedT);
+            T->run();
+        });
+    }
+
+    void shutdown() override { Pool.wait(); }
+};
 
 
 class JIT {
@@ -32,34 +61,78 @@ private:
 
     std::unique_ptr<llvm::orc::IRTransformLayer> OptIRLayer;
 
+    // Only set up when function bodies are compiled lazily; null otherwise.
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> LCTMgr;
+
+    std::unique_ptr<llvm::orc::CompileOnDemandLayer> CODLayer;
+
     llvm::orc::JITDylib &MainJITDylib;
 
+    SymbolCache Cache;
+
+    // A module that can be replaced while the program runs. Its functions are
+    // reached through stubs defined in the public dylib; every version lives
+    // in its own implementation dylib so old and new code can coexist.
+    struct ReloadableModule {
+        llvm::orc::JITDylib *ImplJD = nullptr;
+        std::unique_ptr<llvm::orc::IndirectStubsManager> Stubs;
+        std::vector<llvm::orc::SymbolStringPtr> Symbols;
+    };
+
+    std::mutex ReloadMutex;
+    llvm::StringMap<ReloadableModule> ReloadableModules;
+    // Implementation dylibs of replaced versions, kept alive until the
+    // caller knows no thread is still executing them.
+    std::vector<llvm::orc::JITDylib *> RetiredDylibs;
+    unsigned NextModuleVersion = 0;
+
 
 public:
     JIT(std::unique_ptr<llvm::orc::ExecutorProcessControl> EPCtrl,
         std::unique_ptr<llvm::orc::ExecutionSession> ExeS,
         llvm::DataLayout DataL,
-        llvm::orc::JITTargetMachineBuilder JTMB)
+        llvm::orc::JITTargetMachineBuilder JTMB,
+        std::unique_ptr<llvm::orc::LazyCallThroughManager> LazyCTMgr = nullptr)
         : EPC(std::move(EPCtrl)),ES(std::move(ExeS)),
         DL(std::move(DataL)),Mangle(*ES,DL),
         ObjectLinkingLayer(std::move(createObjectLinkingLayer(*ES,JTMB))),
-        CompileLayer(std::move(createCompileLayer(*ES, *ObjectLinkingLayer, std::move(JTMB)))),
+        CompileLayer(std::move(createCompileLayer(*ES, *ObjectLinkingLayer, JTMB))),
          OptIRLayer(std::move(
             createOptIRLayer(*ES, *CompileLayer))),
+        LCTMgr(std::move(LazyCTMgr)),
+        CODLayer(LCTMgr ? createCODLayer(*ES, *OptIRLayer, *LCTMgr, JTMB)
+                        : nullptr),
         MainJITDylib(
             ES->createBareJITDylib("<main>")){
         
         MainJITDylib.addGenerator(llvm::cantFail(llvm::orc::DynamicLibrarySearchGenerator::
                             GetForCurrentProcess(
                                 DL.getGlobalPrefix())));
-                            
+
+        ES->registerResourceManager(Cache);
 
         }
 
-static llvm::Expected<std::unique_ptr<JIT>> create() {
+    ~JIT() {
+        // Drains the task dispatcher before the layers go away.
+        if (auto Err = ES->endSession())
+            ES->reportError(std::move(Err));
+        ES->deregisterResourceManager(Cache);
+    }
+
+// NumThreads == 0 keeps SelfExecutorProcessControl's default dynamic thread
+// pool, which starts a thread per task. LazyCompile defers compiling each function body until its first call.
+static llvm::Expected<std::unique_ptr<JIT>> create(unsigned NumThreads = 0,
+                                                   bool LazyCompile = false) {
     auto SSP = std::make_shared<llvm::orc::SymbolStringPool>();
 
-    auto EPC = llvm::orc::SelfExecutorProcessControl::Create(SSP);
+    // Without a dispatcher SelfExecutorProcessControl installs a
+    // DynamicThreadPoolTaskDispatcher.
+    std::unique_ptr<llvm::orc::TaskDispatcher> D;
+    if (NumThreads > 0)
+        D = std::make_unique<ThreadPoolTaskDispatcher>(NumThreads);
+
+    auto EPC = llvm::orc::SelfExecutorProcessControl::Create(SSP, std::move(D));
 
     if(!EPC) {
         return EPC.takeError();
@@ -74,7 +147,17 @@ static llvm::Expected<std::unique_ptr<JIT>> create() {
 
     auto ES = std::make_unique<llvm::orc::ExecutionSession>(std::move(*EPC));
 
-    return std::make_unique<JIT>(std::move(*EPC), std::move(ES), std::move(*DL), std::move(JTMB));
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> LCTMgr;
+    if (LazyCompile) {
+        auto LCTM = llvm::orc::createLocalLazyCallThroughManager(
+            JTMB.getTargetTriple(), *ES, llvm::orc::ExecutorAddr());
+        if (!LCTM)
+            return LCTM.takeError();
+        LCTMgr = std::move(*LCTM);
+    }
+
+    return std::make_unique<JIT>(std::move(*EPC), std::move(ES), std::move(*DL),
+                                 std::move(JTMB), std::move(LCTMgr));
 }
 
 static std::unique_ptr<llvm::orc::RTDyldObjectLinkingLayer> createObjectLinkingLayer(
@@ -101,6 +184,8 @@ static std::unique_ptr<llvm::orc::IRCompileLayer> createCompileLayer(
             llvm::orc::RTDyldObjectLinkingLayer &OLLayer,
             llvm::orc::JITTargetMachineBuilder JTMB){
         
+        // Creates a TargetMachine per compile, so it is safe to run on any
+        // number of materialization threads.
         auto IRCompiler = std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(JTMB));
 
         auto IRCLayer = std::make_unique<llvm::orc::IRCompileLayer>(ES,OLLayer,std::move(IRCompiler));
@@ -117,25 +202,310 @@ static std::unique_ptr<llvm::orc::IRTransformLayer> createOptIRLayer(
         return OptIRLayer;            
 }
 
+static std::unique_ptr<llvm::orc::CompileOnDemandLayer> createCODLayer(
+                llvm::orc::ExecutionSession &ES,
+                llvm::orc::IRTransformLayer &OptIRLayer,
+                llvm::orc::LazyCallThroughManager &LCTMgr,
+                llvm::orc::JITTargetMachineBuilder &JTMB){
+        auto CODLayer = std::make_unique<llvm::orc::CompileOnDemandLayer>(
+            ES, OptIRLayer, LCTMgr,
+            llvm::orc::createLocalIndirectStubsManagerBuilder(JTMB.getTargetTriple()));
+
+        // Each function is extracted into its own module, so the bodies that
+        // get called are optimized and compiled independently of each other.
+        CODLayer->setPartitionFunction(materializeRequested);
+
+        return CODLayer;
+}
+
+// Like CompileOnDemandLayer::compileRequested, but first reads in the bodies
+// of the requested functions if the module was loaded lazily from bitcode.
+static std::optional<llvm::orc::CompileOnDemandLayer::GlobalValueSet>
+materializeRequested(llvm::orc::CompileOnDemandLayer::GlobalValueSet Requested) {
+        for (const llvm::GlobalValue *GV : Requested)
+            if (auto Err = const_cast<llvm::GlobalValue *>(GV)->materialize())
+                llvm::report_fatal_error(std::move(Err));
+
+        return llvm::orc::CompileOnDemandLayer::compileRequested(std::move(Requested));
+}
+
+// Event listeners (gdb, perf) must be registered here before any module is
+// materialized to see its objects.
+llvm::orc::RTDyldObjectLinkingLayer &getObjLinkingLayer() {
+    return *ObjectLinkingLayer;
+}
+
+// Modules are optimized and compiled in parallel only if each one owns its
+// ThreadSafeContext; modules sharing a context serialize on its lock.
 llvm::Error addIRModule(llvm::orc::ThreadSafeModule TSM,
                         llvm::orc::ResourceTrackerSP RT = nullptr) {
 
             if(!RT){
                 RT = MainJITDylib.getDefaultResourceTracker();
             } 
+            // The cache attributes unrecorded names to the default tracker, so
+            // only modules added under other trackers need their names noted.
+            auto &JD = RT->getJITDylib();
+            if(RT != JD.getDefaultResourceTracker()) {
+                TSM.withModuleDo([&](llvm::Module &M) {
+                    for (auto &GV : M.global_values())
+                        if (!GV.isDeclaration() && !GV.hasLocalLinkage())
+                            Cache.setOwner(JD, GV.getName(), RT->getKeyUnsafe());
+                });
+            }
+            if(CODLayer)
+                return CODLayer->add(RT,std::move(TSM));
             return OptIRLayer->add(RT,std::move(TSM));               
 
 }
 
 
+// Addresses are cached per dylib and name until the tracker that defined
+// them is removed, so repeated lookups neither mangle nor lock.
 llvm::Expected<llvm::orc::ExecutorSymbolDef> lookup(llvm::StringRef Name) {
-    return ES->lookup({&MainJITDylib},Mangle(Name.str()));
+    return lookup(MainJITDylib, Name);
+}
+
+llvm::Expected<llvm::orc::ExecutorSymbolDef> lookup(llvm::orc::JITDylib &JD,
+                                                    llvm::StringRef Name) {
+    if (auto Sym = Cache.find(JD, Name))
+        return *Sym;
+
+    uint64_t Epoch = Cache.getEpoch();
+    auto Sym = ES->lookup({&JD},Mangle(Name));
+    if (Sym)
+        Cache.insert(JD, Name, *Sym, Epoch);
+    return Sym;
+}
+
+// Resolves all of Names with a single session query (plus cache hits). The
+// result is in the same order as Names.
+llvm::Expected<std::vector<llvm::orc::ExecutorSymbolDef>>
+lookup(llvm::ArrayRef<llvm::StringRef> Names) {
+    return lookup(MainJITDylib, Names);
 }
 
+llvm::Expected<std::vector<llvm::orc::ExecutorSymbolDef>>
+lookup(llvm::orc::JITDylib &JD, llvm::ArrayRef<llvm::StringRef> Names) {
+    std::vector<llvm::orc::ExecutorSymbolDef> Result(Names.size());
+
+    llvm::orc::SymbolLookupSet Missing;
+    std::vector<std::pair<size_t, llvm::orc::SymbolStringPtr>> MissingIdx;
+    for (size_t I = 0, E = Names.size(); I != E; ++I) {
+        if (auto Sym = Cache.find(JD, Names[I])) {
+            Result[I] = *Sym;
+            continue;
+        }
+        auto Mangled = Mangle(Names[I]);
+        Missing.add(Mangled);
+        MissingIdx.push_back({I, std::move(Mangled)});
+    }
+    if (MissingIdx.empty())
+        return Result;
+
+    Missing.removeDuplicates();
+    uint64_t Epoch = Cache.getEpoch();
+    auto Syms = ES->lookup(llvm::orc::makeJITDylibSearchOrder(&JD), std::move(Missing));
+    if (!Syms)
+        return Syms.takeError();
+
+    for (auto &[I, Mangled] : MissingIdx) {
+        Result[I] = (*Syms)[Mangled];
+        Cache.insert(JD, Names[I], Result[I], Epoch);
+    }
+    return Result;
+}
+
+llvm::orc::JITDylib &getMainJITDylib() { return MainJITDylib; }
+
+// Creates a dylib that searches itself, then LinkOrder, then MainJITDylib
+// (and through it the host process) for undefined symbols.
+llvm::Expected<llvm::orc::JITDylib &> createJITDylib(
+        llvm::StringRef Name,
+        llvm::ArrayRef<llvm::orc::JITDylib *> LinkOrder = {}) {
+    auto JD = ES->createJITDylib(Name.str());
+    if (!JD)
+        return JD.takeError();
+
+    llvm::orc::JITDylibSearchOrder Order =
+        llvm::orc::makeJITDylibSearchOrder(LinkOrder);
+    if (llvm::find(LinkOrder, &MainJITDylib) == LinkOrder.end())
+        Order.push_back({&MainJITDylib,
+                         llvm::orc::JITDylibLookupFlags::MatchExportedSymbolsOnly});
+    JD->setLinkOrder(std::move(Order));
+
+    return *JD;
+}
+
+// Adds TSM to JD under ModuleName so that it can later be swapped out with
+// replaceModule(). The module is compiled before this returns.
+llvm::Error addReloadableModule(llvm::orc::JITDylib &JD, llvm::StringRef ModuleName,
+                                llvm::orc::ThreadSafeModule TSM) {
+    std::lock_guard<std::mutex> Lock(ReloadMutex);
+
+    std::string Key = reloadableModuleKey(JD, ModuleName);
+    if (ReloadableModules.count(Key))
+        return llvm::make_error<llvm::StringError>(
+            "module " + Key + " is already loaded", llvm::inconvertibleErrorCode());
+
+    llvm::orc::JITDylib *ImplJD = nullptr;
+    auto Syms = emitModuleVersion(JD, ModuleName, std::move(TSM), ImplJD);
+    if (!Syms)
+        return Syms.takeError();
+
+    ReloadableModule RM;
+    RM.ImplJD = ImplJD;
+    RM.Stubs = llvm::orc::createLocalIndirectStubsManagerBuilder(
+        ES->getExecutorProcessControl().getTargetTriple())();
+    if (auto Err = addStubs(JD, RM, *Syms))
+        return Err;
+
+    ReloadableModules[Key] = std::move(RM);
+    return llvm::Error::success();
+}
+
+// Compiles the new version of ModuleName and then repoints every stub at it.
+// Threads already inside the old version keep running it; its memory is only
+// released by releaseRetiredModules(). The new version must define at least
+// the functions of the old one.
+llvm::Error replaceModule(llvm::orc::JITDylib &JD, llvm::StringRef ModuleName,
+                          llvm::orc::ThreadSafeModule TSM) {
+    std::lock_guard<std::mutex> Lock(ReloadMutex);
+
+    std::string Key = reloadableModuleKey(JD, ModuleName);
+    auto I = ReloadableModules.find(Key);
+    if (I == ReloadableModules.end())
+        return llvm::make_error<llvm::StringError>(
+            "module " + Key + " was not loaded", llvm::inconvertibleErrorCode());
+    ReloadableModule &RM = I->second;
+
+    llvm::orc::JITDylib *ImplJD = nullptr;
+    auto Syms = emitModuleVersion(JD, ModuleName, std::move(TSM), ImplJD);
+    if (!Syms)
+        return Syms.takeError();
+
+    for (auto &Name : RM.Symbols) {
+        if (!Syms->count(Name)) {
+            if (auto Err = ES->removeJITDylib(*ImplJD))
+                return Err;
+            return llvm::make_error<llvm::StringError>(
+                "new version of " + Key + " does not define " + *Name,
+                llvm::inconvertibleErrorCode());
+        }
+    }
+
+    // Functions that are new in this version get fresh stubs; the others are
+    // redirected. Each pointer update is a single atomic store.
+    llvm::orc::SymbolMap NewSyms;
+    for (auto &KV : *Syms) {
+        if (RM.Stubs->findStub(*KV.first, false).getAddress())
+            continue;
+        NewSyms.insert(KV);
+    }
+    if (auto Err = addStubs(JD, RM, NewSyms))
+        return Err;
+    for (auto &KV : *Syms)
+        if (auto Err = RM.Stubs->updatePointer(*KV.first, KV.second.getAddress()))
+            return Err;
+
+    RetiredDylibs.push_back(RM.ImplJD);
+    RM.ImplJD = ImplJD;
+    return llvm::Error::success();
+}
+
+// Frees the code of all replaced module versions. Only call this once no
+// thread can still be executing (or returning into) an old version.
+llvm::Error releaseRetiredModules() {
+    std::vector<llvm::orc::JITDylib *> Retired;
+    {
+        std::lock_guard<std::mutex> Lock(ReloadMutex);
+        Retired.swap(RetiredDylibs);
+    }
+
+    llvm::Error Err = llvm::Error::success();
+    for (auto *JD : Retired)
+        Err = llvm::joinErrors(std::move(Err), ES->removeJITDylib(*JD));
+    return Err;
+}
+
+private:
+
+static std::string reloadableModuleKey(llvm::orc::JITDylib &JD,
+                                       llvm::StringRef ModuleName) {
+    return (JD.getName() + "/" + ModuleName).str();
+}
+
+// Compiles one version of a reloadable module into a new implementation
+// dylib and returns the addresses of the external functions it defines.
+llvm::Expected<llvm::orc::SymbolMap> emitModuleVersion(
+        llvm::orc::JITDylib &JD, llvm::StringRef ModuleName,
+        llvm::orc::ThreadSafeModule TSM, llvm::orc::JITDylib *&ImplJD) {
+    llvm::orc::SymbolLookupSet Functions;
+    TSM.withModuleDo([&](llvm::Module &M) {
+        for (auto &F : M)
+            if (!F.isDeclaration() && !F.hasLocalLinkage())
+                Functions.add(Mangle(F.getName()));
+    });
+
+    auto Impl = ES->createJITDylib(
+        (JD.getName() + "." + ModuleName + ".v" +
+         llvm::Twine(NextModuleVersion++)).str());
+    if (!Impl)
+        return Impl.takeError();
+    ImplJD = &*Impl;
+
+    // Everything the module does not define itself resolves the same way it
+    // would from the public dylib.
+    auto Order = JD.withLinkOrderDo(
+        [](const llvm::orc::JITDylibSearchOrder &O) { return O; });
+    ImplJD->setLinkOrder(std::move(Order));
+
+    if (auto Err = addIRModule(std::move(TSM), ImplJD->getDefaultResourceTracker()))
+        return std::move(Err);
+
+    // Compile now, so that swapping the stubs is all that happens at
+    // replacement time.
+    auto Syms = ES->lookup(
+        llvm::orc::makeJITDylibSearchOrder(
+            ImplJD, llvm::orc::JITDylibLookupFlags::MatchAllSymbols),
+        std::move(Functions));
+    if (!Syms) {
+        llvm::Error Err = Syms.takeError();
+        return llvm::joinErrors(std::move(Err), ES->removeJITDylib(*ImplJD));
+    }
+    return Syms;
+}
+
+llvm::Error addStubs(llvm::orc::JITDylib &JD, ReloadableModule &RM,
+                     const llvm::orc::SymbolMap &Syms) {
+    if (Syms.empty())
+        return llvm::Error::success();
+
+    llvm::orc::IndirectStubsManager::StubInitsMap Inits;
+    for (auto &KV : Syms)
+        Inits[*KV.first] = {KV.second.getAddress(), KV.second.getFlags()};
+    if (auto Err = RM.Stubs->createStubs(Inits))
+        return Err;
+
+    llvm::orc::SymbolMap StubSyms;
+    for (auto &KV : Syms) {
+        StubSyms[KV.first] = RM.Stubs->findStub(*KV.first, false);
+        RM.Symbols.push_back(KV.first);
+    }
+    return JD.define(llvm::orc::absoluteSymbols(std::move(StubSyms)));
+}
+
+public:
+
 
 static llvm::Expected<llvm::orc::ThreadSafeModule> optimizeModule(llvm::orc::ThreadSafeModule TSM, 
                     const llvm::orc::MaterializationResponsibility &R) {
-        TSM.withModuleDo([](llvm::Module &M){
+        if (auto Err = TSM.withModuleDo([](llvm::Module &M) -> llvm::Error {
+            // Modules loaded lazily from bitcode only get their function
+            // bodies read in here, once something in them is looked up.
+            if (auto Err = M.materializeAll())
+                return Err;
+
             llvm::PassBuilder PB;
             llvm::LoopAnalysisManager LAM;
             llvm::FunctionAnalysisManager FAM;
@@ -152,7 +522,9 @@ static llvm::Expected<llvm::orc::ThreadSafeModule> optimizeModule(llvm::orc::Thr
             llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
             MPM.run(M,MAM);
 
-        });    
+            return llvm::Error::success();
+        }))
+            return std::move(Err);
 
         return TSM;           
 
@@ -0,0 +1,73 @@
+#ifndef PERFMAPLISTENER_H
+#define PERFMAPLISTENER_H
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <string>
+
+// Appends "<start> <size> <name>" lines for every JIT'd function to
+// /tmp/perf-<pid>.map, which `perf top`/`perf report` read to symbolize
+// addresses that do not belong to any mapped file.
+class PerfMapListener : public llvm::JITEventListener {
+
+    std::mutex Lock;
+    std::unique_ptr<llvm::raw_fd_ostream> OS;
+
+public:
+    PerfMapListener() {
+        std::string Path =
+            "/tmp/perf-" + std::to_string(llvm::sys::Process::getProcessId()) + ".map";
+        std::error_code EC;
+        OS = std::make_unique<llvm::raw_fd_ostream>(Path, EC, llvm::sys::fs::OF_Append);
+        if (EC) {
+            llvm::errs() << "Could not open " << Path << ": " << EC.message() << "\n";
+            OS.reset();
+        }
+    }
+
+    void notifyObjectLoaded(ObjectKey K, const llvm::object::ObjectFile &Obj,
+                            const llvm::RuntimeDyld::LoadedObjectInfo &L) override {
+        if (!OS)
+            return;
+
+        // The debug object has its symbol addresses relocated to where the
+        // sections were actually loaded.
+        llvm::object::OwningBinary<llvm::object::ObjectFile> DebugObjOwner =
+            L.getObjectForDebug(Obj);
+        const llvm::object::ObjectFile *DebugObj = DebugObjOwner.getBinary();
+        if (!DebugObj)
+            return;
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        for (const auto &P : llvm::object::computeSymbolSizes(*DebugObj)) {
+            llvm::object::SymbolRef Sym = P.first;
+
+            auto Type = Sym.getType();
+            if (!Type) {
+                llvm::consumeError(Type.takeError());
+                continue;
+            }
+            if (*Type != llvm::object::SymbolRef::ST_Function)
+                continue;
+
+            auto Name = Sym.getName();
+            auto Addr = Sym.getAddress();
+            if (!Name || !Addr) {
+                llvm::consumeError(Name.takeError());
+                llvm::consumeError(Addr.takeError());
+                continue;
+            }
+
+            *OS << llvm::format_hex_no_prefix(*Addr, 1) << " "
+                << llvm::format_hex_no_prefix(P.second, 1) << " " << *Name << "\n";
+        }
+        OS->flush();
+    }
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef SYMBOLCACHE_H
+#define SYMBOLCACHE_H
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Caches resolved addresses by (JITDylib, unmangled name) so that repeated
+// lookups skip name mangling and the session lock entirely.
+//
+// find() never blocks: the table is open-addressed with atomic slots, entries
+// are immutable once published, and invalidated entries are replaced by a
+// tombstone. Writers serialize on a mutex. Outgrown tables and replaced
+// entries are retired, and freed by the next writer that finds no reader
+// inside find(), so a reader can never see freed memory.
+//
+// Registered as a ResourceManager, the cache drops every address owned by a
+// ResourceTracker as soon as that tracker is removed, before the code is
+// freed. An address resolved before the removal but inserted after it would
+// outlive the code, so insert() drops addresses resolved before the last
+// removal (see getEpoch()).
+class SymbolCache : public llvm::orc::ResourceManager {
+
+    struct Entry {
+        const llvm::orc::JITDylib *JD;
+        std::string Name;
+        size_t Hash;
+        llvm::orc::ExecutorSymbolDef Sym;
+        llvm::orc::ResourceKey Key;
+    };
+
+    struct Table {
+        explicit Table(size_t Size)
+            : Size(Size), Slots(new std::atomic<const Entry *>[Size]) {
+            for (size_t I = 0; I != Size; ++I)
+                Slots[I].store(nullptr, std::memory_order_relaxed);
+        }
+
+        size_t Size;
+        std::unique_ptr<std::atomic<const Entry *>[]> Slots;
+        // Live entries plus tombstones; only touched by writers.
+        size_t Used = 0;
+    };
+
+    static constexpr size_t MinTableSize = 64;
+
+    Entry Tombstone{};
+    std::atomic<Table *> Current;
+    // The current table followed by the retired ones.
+    std::vector<std::unique_ptr<Table>> Tables;
+    size_t Live = 0;
+    // Entries no longer in the current table, but maybe still in a retired
+    // one or in the hands of a reader.
+    std::vector<std::unique_ptr<const Entry>> Retired;
+    // Number of threads inside find().
+    mutable std::atomic<unsigned> Readers{0};
+    // Bumped by every removal of a tracker.
+    std::atomic<uint64_t> Epoch{0};
+
+    std::mutex WriteMutex;
+    // The tracker that defined each name. Names without an entry belong to
+    // their dylib's default tracker.
+    std::map<std::pair<const llvm::orc::JITDylib *, std::string>,
+             llvm::orc::ResourceKey> Owners;
+
+    static size_t hash(const llvm::orc::JITDylib &JD, llvm::StringRef Name) {
+        return llvm::hash_combine(&JD, Name);
+    }
+
+    // Writers only. Rehashes the live entries into a table sized for them and
+    // publishes it; readers still probing the old one are unaffected.
+    Table *grow() {
+        Table *Old = Current.load(std::memory_order_relaxed);
+        size_t Size = MinTableSize;
+        while (Size < Live * 4)
+            Size *= 2;
+
+        auto New = std::make_unique<Table>(Size);
+        for (size_t I = 0; I != Old->Size; ++I) {
+            const Entry *E = Old->Slots[I].load(std::memory_order_relaxed);
+            if (!E || E == &Tombstone)
+                continue;
+            size_t Slot = E->Hash & (Size - 1);
+            while (New->Slots[Slot].load(std::memory_order_relaxed))
+                Slot = (Slot + 1) & (Size - 1);
+            New->Slots[Slot].store(E, std::memory_order_relaxed);
+            ++New->Used;
+        }
+
+        Table *T = New.get();
+        Tables.insert(Tables.begin(), std::move(New));
+        Current.store(T, std::memory_order_seq_cst);
+        return T;
+    }
+
+    // Writers only. Removes E from the current table's accounting; it is
+    // freed with the retired tables.
+    void retire(const Entry *E) { Retired.emplace_back(E); }
+
+    // Writers only. A reader increments Readers before it loads Current or a
+    // slot, all seq_cst. The fence orders the caller's unpublishing stores
+    // before the load of Readers, so either the reader is counted or its loads
+    // come after the fence and see the new table and slots; once Readers is 0,
+    // no reader can reach the retired tables or entries any more.
+    void reclaim() {
+        if (Tables.size() == 1 && Retired.empty())
+            return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (Readers.load(std::memory_order_seq_cst) != 0)
+            return;
+        Tables.resize(1);
+        Retired.clear();
+    }
+
+    // Writers only. Tombstones matching entries in every table, including
+    // outgrown ones that a slow reader may still be probing.
+    template <typename Pred> void invalidateIf(Pred P) {
+        Table *Cur = Current.load(std::memory_order_relaxed);
+        for (auto &T : Tables) {
+            for (size_t I = 0; I != T->Size; ++I) {
+                const Entry *E = T->Slots[I].load(std::memory_order_relaxed);
+                if (!E || E == &Tombstone || !P(*E))
+                    continue;
+                T->Slots[I].store(&Tombstone, std::memory_order_release);
+                if (T.get() == Cur) {
+                    --Live;
+                    retire(E);
+                }
+            }
+        }
+    }
+
+    // Drops cached addresses owned by K and hands its names to NewK, or
+    // forgets them if NewK is 0.
+    void rekey(llvm::orc::ResourceKey K, llvm::orc::ResourceKey NewK) {
+        std::lock_guard<std::mutex> Lock(WriteMutex);
+        if (!NewK)
+            Epoch.fetch_add(1, std::memory_order_acq_rel);
+        invalidateIf([K](const Entry &E) { return E.Key == K; });
+        for (auto I = Owners.begin(); I != Owners.end();) {
+            if (I->second != K) {
+                ++I;
+            } else if (NewK) {
+                I->second = NewK;
+                ++I;
+            } else {
+                I = Owners.erase(I);
+            }
+        }
+        reclaim();
+    }
+
+public:
+    SymbolCache() {
+        Tables.push_back(std::make_unique<Table>(MinTableSize));
+        Current.store(Tables.back().get(), std::memory_order_release);
+    }
+
+    ~SymbolCache() {
+        Table *T = Current.load(std::memory_order_relaxed);
+        for (size_t I = 0; I != T->Size; ++I) {
+            const Entry *E = T->Slots[I].load(std::memory_order_relaxed);
+            if (E && E != &Tombstone)
+                delete E;
+        }
+    }
+
+    std::optional<llvm::orc::ExecutorSymbolDef> find(const llvm::orc::JITDylib &JD,
+                                                     llvm::StringRef Name) const {
+        size_t H = hash(JD, Name);
+        std::optional<llvm::orc::ExecutorSymbolDef> Result;
+        Readers.fetch_add(1, std::memory_order_seq_cst);
+        const Table *T = Current.load(std::memory_order_seq_cst);
+        size_t Mask = T->Size - 1;
+        for (size_t Slot = H & Mask, N = 0; N != T->Size; Slot = (Slot + 1) & Mask, ++N) {
+            const Entry *E = T->Slots[Slot].load(std::memory_order_seq_cst);
+            if (!E)
+                break;
+            if (E != &Tombstone && E->Hash == H && E->JD == &JD && E->Name == Name) {
+                Result = E->Sym;
+                break;
+            }
+        }
+        Readers.fetch_sub(1, std::memory_order_release);
+        return Result;
+    }
+
+    // Read before resolving an address that is to be passed to insert().
+    uint64_t getEpoch() const { return Epoch.load(std::memory_order_acquire); }
+
+    // Records that Name in JD is defined by the tracker with key K.
+    void setOwner(const llvm::orc::JITDylib &JD, llvm::StringRef Name,
+                  llvm::orc::ResourceKey K) {
+        std::lock_guard<std::mutex> Lock(WriteMutex);
+        Owners[{&JD, Name.str()}] = K;
+    }
+
+    // Caches Sym, which was resolved after getEpoch() returned ResolvedEpoch.
+    // If a tracker was removed since, Sym may belong to it and is dropped.
+    void insert(llvm::orc::JITDylib &JD, llvm::StringRef Name,
+                llvm::orc::ExecutorSymbolDef Sym, uint64_t ResolvedEpoch) {
+        // Takes the session lock, so fetch it before taking ours.
+        llvm::orc::ResourceKey DefaultK = JD.getDefaultResourceTracker()->getKeyUnsafe();
+        {
+            std::lock_guard<std::mutex> Lock(WriteMutex);
+            if (Epoch.load(std::memory_order_relaxed) != ResolvedEpoch)
+                return;
+            auto I = Owners.find({&JD, Name.str()});
+            llvm::orc::ResourceKey K = I != Owners.end() ? I->second : DefaultK;
+
+            auto *E = new Entry{&JD, Name.str(), hash(JD, Name), Sym, K};
+
+            Table *T = Current.load(std::memory_order_relaxed);
+            if ((T->Used + 1) * 2 > T->Size)
+                T = grow();
+
+            size_t Mask = T->Size - 1;
+            size_t Slot = E->Hash & Mask;
+            for (;; Slot = (Slot + 1) & Mask) {
+                const Entry *Old = T->Slots[Slot].load(std::memory_order_relaxed);
+                if (!Old)
+                    break;
+                if (Old != &Tombstone && Old->Hash == E->Hash && Old->JD == &JD &&
+                    Old->Name == Name) {
+                    T->Slots[Slot].store(E, std::memory_order_release);
+                    retire(Old);
+                    reclaim();
+                    return;
+                }
+            }
+            T->Slots[Slot].store(E, std::memory_order_release);
+            ++T->Used;
+            ++Live;
+            reclaim();
+        }
+    }
+
+    llvm::Error handleRemoveResources(llvm::orc::JITDylib &JD,
+                                      llvm::orc::ResourceKey K) override {
+        rekey(K, 0);
+        return llvm::Error::success();
+    }
+
+    // Cached entries are immutable, so the moved ones are dropped and picked
+    // up again under their new owner by the next lookup.
+    void handleTransferResources(llvm::orc::JITDylib &JD, llvm::orc::ResourceKey DstK,
+                                 llvm::orc::ResourceKey SrcK) override {
+        rekey(SrcK, DstK);
+    }
+};
+
+#endif
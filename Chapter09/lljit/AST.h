@@ -2,7 +2,9 @@
 #define AST_H
 
 #include "llvm/ADT/SmallVector.h"
+#include "Types.h"
 #include "llvm/ADT/StringRef.h"
+#include <string>
 
 class AST;
 class Expr;
@@ -35,9 +37,13 @@ public:
 };
 
 class Expr : public AST {
+    // Set by Sema.
+    ValueType Ty = ValueType::I32;
 
 public:
     Expr() {}
+    ValueType getType() const { return Ty; }
+    void setType(ValueType T) { Ty = T; }
 };
 
 
@@ -48,10 +54,17 @@ public:
 private:
     ValueKind Kind;
     llvm::StringRef Val;
+    // Text of a number that is not in the source, e.g. a folded constant.
+    std::string Storage;
 
 public:
     Factor(ValueKind Kind, llvm::StringRef Val)
         : Kind(Kind), Val(Val){}
+    explicit Factor(const CalcValue &Value)
+        : Kind(Number), Storage(Value.toLiteral()) {
+        Val = Storage;
+        setType(Value.Ty);
+    }
     ValueKind getKind() { return Kind;}
 
     llvm::StringRef getVal() {return Val;}
@@ -80,6 +93,8 @@ public:
         : Op(Op), Left(L), Right(R) {}
     Expr *getLeft() {return Left;}
     Expr *getRight() {return Right;}
+    void setLeft(Expr *L) {Left = L;}
+    void setRight(Expr *R) {Right = R;}
     Operator getOperator() {return Op;}
 
     virtual void accept(ASTVisitor &V) override {
@@ -89,17 +104,29 @@ public:
 class DefDecl : public AST {
   llvm::StringRef DefFnName;
   using VarVector = llvm::SmallVector<llvm::StringRef, 8>;
+  using TypeVector = llvm::SmallVector<ValueType, 8>;
   VarVector Vars;
+  // Declared type of each of the Vars; i32 unless given.
+  TypeVector Types;
   Expr *E;
 
 public:
   DefDecl(llvm::StringRef DefFnName, llvm::SmallVector<llvm::StringRef, 8> Vars,
-           Expr *E)
-      : DefFnName(DefFnName), Vars(Vars), E(E) {}
+           TypeVector Types, Expr *E)
+      : DefFnName(DefFnName), Vars(Vars), Types(Types), E(E) {}
   VarVector::const_iterator begin() { return Vars.begin(); }
   VarVector::const_iterator end() { return Vars.end(); }
   Expr *getExpr() { return E; }
+  void setExpr(Expr *Ex) { E = Ex; }
   virtual VarVector getVars() const { return Vars; }
+  const TypeVector &getTypes() const { return Types; }
+  // The result has the type of the expression, which Sema determines.
+  FunctionSignature getSignature() const {
+    FunctionSignature Sig;
+    Sig.Params = Types;
+    Sig.Result = E->getType();
+    return Sig;
+  }
   virtual void accept(ASTVisitor &V) override {
     V.visit(*this);
   }
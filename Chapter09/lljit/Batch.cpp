@@ -0,0 +1,91 @@
+#include "Batch.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+Error batchError(const Twine &Msg) {
+  return make_error<StringError>(Msg, inconvertibleErrorCode());
+}
+
+Error readCSV(const MemoryBuffer &Buf, size_t NumArgs,
+              std::vector<std::vector<int>> &Columns) {
+  Columns.resize(NumArgs);
+  SmallVector<StringRef, 8> Fields;
+  for (line_iterator I(Buf, /*SkipBlanks=*/true); !I.is_at_end(); ++I) {
+    Fields.clear();
+    I->split(Fields, ',');
+    if (Fields.size() != NumArgs)
+      return batchError("line " + Twine(I.line_number()) + ": expected " +
+                        Twine(NumArgs) + " values");
+    for (size_t Col = 0; Col != NumArgs; ++Col) {
+      int Val;
+      if (Fields[Col].trim().getAsInteger(10, Val))
+        return batchError("line " + Twine(I.line_number()) +
+                          ": invalid number '" + Fields[Col].trim() + "'");
+      Columns[Col].push_back(Val);
+    }
+  }
+  return Error::success();
+}
+} // namespace
+
+Error runBatch(FunctionCaller &Caller, StringRef FnName, size_t NumArgs,
+               StringRef InputPath, StringRef OutputPath) {
+  auto BufOrErr = MemoryBuffer::getFile(InputPath);
+  if (!BufOrErr)
+    return errorCodeToError(BufOrErr.getError());
+  const MemoryBuffer &Buf = **BufOrErr;
+  bool IsCSV = InputPath.endswith(".csv");
+
+  // Columnar input is used in place; CSV input is parsed into columns first.
+  std::vector<std::vector<int>> CSVColumns;
+  SmallVector<const int *, 8> Columns;
+  size_t N;
+  if (IsCSV) {
+    if (auto Err = readCSV(Buf, NumArgs, CSVColumns))
+      return Err;
+    N = NumArgs ? CSVColumns[0].size() : 0;
+    for (auto &Col : CSVColumns)
+      Columns.push_back(Col.data());
+  } else {
+    size_t ColumnBytes = NumArgs * sizeof(int);
+    if (!NumArgs || Buf.getBufferSize() % ColumnBytes)
+      return batchError(InputPath + ": size is not a multiple of " +
+                        Twine(NumArgs) + " int32 columns");
+    N = Buf.getBufferSize() / ColumnBytes;
+    const int *Data = reinterpret_cast<const int *>(Buf.getBufferStart());
+    for (size_t Col = 0; Col != NumArgs; ++Col)
+      Columns.push_back(Data + Col * N);
+  }
+
+  std::vector<int> Results(N);
+  auto Start = std::chrono::steady_clock::now();
+  if (auto Err = Caller.callBatch(FnName, Columns, Results.data(), N))
+    return Err;
+  std::chrono::duration<double, std::milli> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputPath, EC,
+                    IsCSV ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC)
+    return errorCodeToError(EC);
+  if (IsCSV) {
+    for (int Res : Results)
+      OS << Res << "\n";
+  } else {
+    OS.write(reinterpret_cast<const char *>(Results.data()),
+             Results.size() * sizeof(int));
+  }
+
+  errs() << "Evaluated " << N << " rows in "
+         << format("%.3f", Elapsed.count()) << " ms\n";
+  return Error::success();
+}
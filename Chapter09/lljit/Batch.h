@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Caller.h"
+#include "llvm/Support/Error.h"
+
+// Evaluates FnName over every argument tuple in InputPath and writes one
+// result per tuple to OutputPath ("-" for stdout).
+//
+// A ".csv" input holds one comma separated tuple per line and produces one
+// result per line. Any other input is binary columnar: NumArgs consecutive
+// columns of native-endian int32 values, all of the same length; the output
+// is then a single int32 column.
+llvm::Error runBatch(FunctionCaller &Caller, llvm::StringRef FnName,
+                     size_t NumArgs, llvm::StringRef InputPath,
+                     llvm::StringRef OutputPath);
+
+#endif
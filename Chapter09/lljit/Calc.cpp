@@ -1,16 +1,174 @@
+#include "Batch.h"
+#include "Caller.h"
 #include "CodeGen.h"
+#include "Library.h"
 #include "Parser.h"
 #include "Sema.h"
+#include "Server.h"
+#include "PerfMapListener.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/TargetSelect.h"
+#include <chrono>
+#include <fstream>
 #include <iostream>
 
 using namespace llvm;
 using namespace llvm::orc;
 
+static cl::opt<bool>
+    PerfEvents("perf-events",
+               cl::desc("Register the perf JIT event listener (jitdump)"),
+               cl::init(false));
+
+static cl::opt<bool>
+    PerfMap("perf-map", cl::desc("Write JIT'd symbols to /tmp/perf-<pid>.map"),
+            cl::init(false));
+
+static cl::opt<bool>
+    GDBEvents("gdb-events",
+              cl::desc("Register JIT'd objects with the gdb JIT interface"),
+              cl::init(false));
+
+static cl::opt<bool> DumpIR("dump-ir",
+                            cl::desc("Print the IR generated for each definition"),
+                            cl::init(false));
+
+static cl::opt<std::string>
+    ServerSocket("server",
+                 cl::desc("Serve requests on a Unix domain socket instead of "
+                          "reading them from stdin"),
+                 cl::value_desc("path"));
+
+static cl::opt<unsigned>
+    ServerThreads("server-threads",
+                  cl::desc("Number of requests evaluated concurrently "
+                           "(0 = one per core)"),
+                  cl::init(0));
+
+static cl::opt<unsigned>
+    CompileThreshold("compile-threshold",
+                     cl::desc("Number of calls to a function that are "
+                              "interpreted before it is compiled"),
+                     cl::init(100));
+
+static cl::opt<unsigned>
+    OptLevel("opt-level",
+             cl::desc("Optimization level of compiled functions (0-3)"),
+             cl::init(2));
+
+static cl::opt<std::string>
+    LibraryDir("library",
+               cl::desc("Directory that definitions are saved to, and "
+                        "loaded from at start-up"),
+               cl::value_desc("dir"));
+
+static cl::opt<std::string>
+    ScriptFile("script",
+               cl::desc("Read definitions and calls from a file instead of "
+                        "stdin"),
+               cl::value_desc("file"));
+
+static cl::opt<bool>
+    FastMath("fast-math",
+             cl::desc("Let floating point code be reassociated and contracted "
+                      "(results may differ in the last bits)"),
+             cl::init(false));
+
 ExitOnError ExitOnErr;
 
+namespace {
+// How an input line was handled.
+enum class LineKind { Empty, Def, Call, Batch, Error, Quit };
+} // namespace
+
+// Handles one input line. Errors are reported on stderr where they are found
+// and only classified here, so a bad line never ends the session. Verbose
+// explains each result as the interactive prompt does.
+static LineKind processLine(const std::string &calcExp, FunctionCaller &Caller,
+                            StringMap<FunctionSignature> &JITtedFunctions,
+                            bool Verbose) {
+  if (StringRef(calcExp).trim().empty())
+    return LineKind::Empty;
+
+  // batch <function> <input> [<output>] evaluates a defined function over
+  // a file of argument tuples (see Batch.h).
+  if (StringRef(calcExp).startswith("batch ")) {
+    SmallVector<StringRef, 4> Parts;
+    StringRef(calcExp).split(Parts, ' ', -1, /*KeepEmpty=*/false);
+    auto Fn = Parts.size() >= 3 ? JITtedFunctions.find(Parts[1])
+                                : JITtedFunctions.end();
+    if (Parts.size() < 3 || Parts.size() > 4) {
+      llvm::errs() << "Usage: batch <function> <input> [<output>]\n";
+      return LineKind::Error;
+    }
+    if (Fn == JITtedFunctions.end()) {
+      llvm::errs() << "Specified function definition does not exist!\n";
+      return LineKind::Error;
+    }
+    if (auto Err = runBatch(Caller, Parts[1], Fn->second.getNumParams(), Parts[2],
+                            Parts.size() == 4 ? Parts[3] : "-")) {
+      logAllUnhandledErrors(std::move(Err), llvm::errs(),
+                            "Batch evaluation failed: ");
+      return LineKind::Error;
+    }
+    return LineKind::Batch;
+  }
+
+  Lexer Lex(calcExp);
+  Token::TokenKind CalcTok = Lex.peek();
+  if (CalcTok == Token::KW_def) {
+    if (auto Err = Caller.define(calcExp, DumpIR)) {
+      logAllUnhandledErrors(std::move(Err), llvm::errs());
+      return LineKind::Error;
+    }
+    return LineKind::Def;
+  }
+  if (calcExp.find("quit") != std::string::npos)
+    return LineKind::Quit;
+  if (CalcTok != Token::ident) {
+    llvm::errs() << "Expect function definition or call!\n";
+    return LineKind::Error;
+  }
+
+  if (Verbose)
+    outs() << "Attempting to evaluate expression:\n";
+  Parser Parser(Lex);
+  std::unique_ptr<AST> Tree(Parser.parse());
+  if (!Tree || Parser.hasError()) {
+    llvm::errs() << "Syntax errors occured\n";
+    return LineKind::Error;
+  }
+  Sema Semantic;
+  if (Semantic.semantic(Tree.get(), JITtedFunctions)) {
+    llvm::errs() << "Semantic errors occured\n";
+    return LineKind::Error;
+  }
+  // The parser only produces a FuncCallFromDef for lines starting with
+  // an identifier.
+  auto *Call = static_cast<FuncCallFromDef *>(Tree.get());
+  SmallVector<CalcValue, 8> Args;
+  for (StringRef Arg : Call->getArgs())
+    Args.push_back(*CalcValue::parse(Arg));
+  // Call the previously compiled user function directly with the
+  // argument values; nothing is generated or compiled for the call.
+  Expected<CalcValue> Result = Caller.call(Call->getFnName(), Args);
+  if (!Result) {
+    logAllUnhandledErrors(Result.takeError(), llvm::errs());
+    return LineKind::Error;
+  }
+  if (Verbose)
+    outs() << "User defined function evaluated to: ";
+  outs() << *Result << "\n";
+  return LineKind::Call;
+}
+
 int main(int argc, const char **argv) {
   llvm::InitLLVM X(argc, argv);
 
@@ -18,84 +176,147 @@ int main(int argc, const char **argv) {
   InitializeNativeTargetAsmPrinter();
   InitializeNativeTargetAsmParser();
 
+  cl::ParseCommandLineOptions(argc, argv, "JIT calculator\n");
+
+  // Must outlive the JIT, which reports freed objects to it on shutdown.
+  std::unique_ptr<PerfMapListener> PerfMapL;
+  // Must outlive the JIT, whose compiler saves objects to it.
+  std::unique_ptr<Library> Lib;
+
   // Create a new LLJITBuilder.
-  auto JIT = ExitOnErr(LLJITBuilder().create());
+  LLJITBuilder Builder;
+  if (!LibraryDir.empty()) {
+    Lib = ExitOnErr(Library::open(LibraryDir, OptLevel, FastMath));
+    Builder.setCompileFunctionCreator([&](JITTargetMachineBuilder JTMB)
+        -> Expected<std::unique_ptr<IRCompileLayer::IRCompiler>> {
+      auto TM = JTMB.createTargetMachine();
+      if (!TM)
+        return TM.takeError();
+      return std::make_unique<TMOwningSimpleCompiler>(std::move(*TM),
+                                                      Lib.get());
+    });
+  }
+  // JIT event listeners only work with RuntimeDyld, so the default object
+  // linking layer is only replaced when profiling or debugging is requested.
+  if (PerfEvents || PerfMap || GDBEvents) {
+    if (PerfMap)
+      PerfMapL = std::make_unique<PerfMapListener>();
+    Builder.setObjectLinkingLayerCreator([&](ExecutionSession &ES,
+                                             const Triple &TT) {
+      auto GetMemMgr = []() { return std::make_unique<SectionMemoryManager>(); };
+      auto ObjLinkingLayer =
+          std::make_unique<RTDyldObjectLinkingLayer>(ES, std::move(GetMemMgr));
+      if (PerfEvents) {
+        if (auto *L = JITEventListener::createPerfJITEventListener())
+          ObjLinkingLayer->registerJITEventListener(*L);
+        else
+          errs() << "warning: LLVM was built without perf support\n";
+      }
+      if (PerfMapL)
+        ObjLinkingLayer->registerJITEventListener(*PerfMapL);
+      if (GDBEvents) {
+        // Keep the debug sections around for the debugger.
+        ObjLinkingLayer->setProcessAllSections(true);
+        ObjLinkingLayer->registerJITEventListener(
+            *JITEventListener::createGDBRegistrationListener());
+      }
+      return ObjLinkingLayer;
+    });
+  }
+  auto JIT = ExitOnErr(Builder.create());
+
+  // Modules are optimized when they are materialized, i.e. only once a
+  // function in them is first looked up.
+  if (OptLevel > 3) {
+    errs() << "Invalid optimization level " << OptLevel << "\n";
+    return 1;
+  }
+  if (OptLevel) {
+    OptimizationLevel Level = OptLevel == 1   ? OptimizationLevel::O1
+                              : OptLevel == 2 ? OptimizationLevel::O2
+                                              : OptimizationLevel::O3;
+    JIT->getIRTransformLayer().setTransform(
+        [Level](ThreadSafeModule TSM, MaterializationResponsibility &R)
+            -> Expected<ThreadSafeModule> {
+          TSM.withModuleDo(
+              [Level](Module &M) { CodeGen::optimize(&M, nullptr, Level); });
+          return std::move(TSM);
+        });
+  }
   // A map to keep track of the functions we've JIT'ed. The representation is
   // a mapping between the name of the user defined function (as a string), and
-  // the name of the arguments (a vector of strings). All of these arguments
-  // will automatically be represented as integers.
-  StringMap<size_t> JITtedFunctions;
+  // its signature: the types of its parameters (i32 unless declared as
+  // e.g. "x:f64") and of its result.
+  StringMap<FunctionSignature> JITtedFunctions;
+  // All modules of the session share one context rather than paying for a
+  // new one per line. It must be locked while IR is built in it.
+  ThreadSafeContext TSCtx(std::make_unique<LLVMContext>());
+  FunctionCaller Caller(*JIT, JITtedFunctions, TSCtx, CompileThreshold,
+                        FastMath);
+  if (Lib) {
+    ExitOnErr(Lib->load(Caller));
+    Caller.setLibrary(Lib.get());
+  }
+
+  if (!ServerSocket.empty()) {
+    ExitOnErr(runServer(Caller, ServerSocket, ServerThreads));
+    return 0;
+  }
 
+  // Prompt and explain results only when a user is typing; otherwise just
+  // print one result per call so the output can be checked by a script.
+  bool Interactive =
+      ScriptFile.empty() && sys::Process::StandardInIsUserInput();
+  std::ifstream ScriptStream;
+  if (!ScriptFile.empty()) {
+    ScriptStream.open(ScriptFile);
+    if (!ScriptStream) {
+      errs() << "Could not open " << ScriptFile << "\n";
+      return 1;
+    }
+  }
+  std::istream &Input = ScriptFile.empty() ? std::cin : ScriptStream;
+  StringRef InputName = ScriptFile.empty() ? StringRef("<stdin>") : ScriptFile;
+  std::ios::sync_with_stdio(false);
+
+  unsigned LineNo = 0, Defs = 0, Calls = 0, Errors = 0;
+  auto Start = std::chrono::steady_clock::now();
+  std::string calcExp;
   while (true) {
-    outs() << "JIT calc > ";
-    std::string calcExp;
-    std::getline(std::cin, calcExp);
-
-    // Create a new context and module.
-    std::unique_ptr<LLVMContext> Ctx = std::make_unique<LLVMContext>();
-    std::unique_ptr<Module> M = std::make_unique<Module>("JIT calc.expr", *Ctx);
-    M->setDataLayout(JIT->getDataLayout());
-
-    // Declare the code generator.
-    CodeGen CodeGenerator;
-
-    Lexer Lex(calcExp);
-    Token::TokenKind CalcTok = Lex.peek();
-    if (CalcTok == Token::KW_def) {
-      Parser Parser(Lex);
-      AST *Tree = Parser.parse();
-      if (!Tree || Parser.hasError()) {
-        llvm::errs() << "Syntax errors occured\n";
-        return 1;
-      }
-      Sema Semantic;
-      if (Semantic.semantic(Tree, JITtedFunctions)) {
-        llvm::errs() << "Semantic errors occured\n";
-        return 1;
-      }
-      // Generate the IR.
-      CodeGenerator.compileToIR(Tree, M.get(), JITtedFunctions);
-      ExitOnErr(
-          JIT->addIRModule(ThreadSafeModule(std::move(M), std::move(Ctx))));
-    } else if (calcExp.find("quit") != std::string::npos) {
-      outs() << "Quitting the JIT calc program.\n";
+    if (Interactive) {
+      outs() << "JIT calc > ";
+      outs().flush();
+    }
+    if (!std::getline(Input, calcExp))
       break;
-    } else if (CalcTok == Token::ident) {
-      outs() << "Attempting to evaluate expression:\n";
-      Parser Parser(Lex);
-      AST *Tree = Parser.parse();
-      if (!Tree || Parser.hasError()) {
-        llvm::errs() << "Syntax errors occured\n";
-        return 1;
-      }
-      Sema Semantic;
-      if (Semantic.semantic(Tree, JITtedFunctions)) {
-        llvm::errs() << "Semantic errors occured\n";
-        return 1;
-      }
-      llvm::StringRef FuncCallName = Tree->getFnName();
-      // Prepare the function call to the JITted (previously defined) function.
-      CodeGenerator.prepareCalculationCallFunc(Tree, M.get(), FuncCallName,
-                                               JITtedFunctions);
-      // A resource tracker will track the memory that is allocated to the
-      // JITted function that calls the user defined function.
-      auto RT = JIT->getMainJITDylib().createResourceTracker();
-      auto TSM = ThreadSafeModule(std::move(M), std::move(Ctx));
-      ExitOnErr(JIT->addIRModule(RT, std::move(TSM)));
-      // Generate the function call by querying the JIT for the temporary
-      // call function (that will call the function defined by the user
-      // to evaluate the calculator expression).
-      auto CalcExprCall = ExitOnErr(JIT->lookup("calc_expr_func"));
-      // Get the address of the symbol for "calc_expr_func" (the temporary call
-      // function, and cast to the appropriate type. This function returns an
-      // integer and takes no arguments. It simply produces a call to the
-      // calculator function (previously) defined by the user.
-      int (*UserFnCall)() = CalcExprCall.toPtr<int (*)()>();
-      outs() << "User defined function evaluated to: " << UserFnCall() << "\n";
-      // Free the memory that was previously allocated.
-      ExitOnErr(RT->remove());
+    ++LineNo;
+
+    LineKind Kind = processLine(calcExp, Caller, JITtedFunctions, Interactive);
+    if (Kind == LineKind::Quit) {
+      if (Interactive)
+        outs() << "Quitting the JIT calc program.\n";
+      break;
+    }
+    Defs += Kind == LineKind::Def;
+    Calls += Kind == LineKind::Call;
+    if (Kind == LineKind::Error) {
+      ++Errors;
+      if (!Interactive)
+        errs() << InputName << ":" << LineNo << ": skipped: " << calcExp
+               << "\n";
     }
   }
 
+  if (!Interactive) {
+    outs().flush();
+    double Secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - Start)
+                      .count();
+    errs() << "Processed " << LineNo << " lines (" << Defs << " definitions, "
+           << Calls << " calls, " << Errors << " errors) in "
+           << format("%.1f", Secs * 1000) << " ms, "
+           << format("%.0f", Secs > 0 ? LineNo / Secs : 0.0) << " lines/s\n";
+    return Errors ? 1 : 0;
+  }
   return 0;
 }
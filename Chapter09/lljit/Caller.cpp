@@ -0,0 +1,319 @@
+#include "Caller.h"
+#include "CodeGen.h"
+#include "ConstantFolder.h"
+#include "Interpreter.h"
+#include "Library.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include <optional>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+// Set by compiled code that divided an integer by zero on this thread.
+static thread_local bool DivByZero = false;
+
+static void divByZeroHook() { DivByZero = true; }
+
+static Error divByZeroError() {
+  return make_error<StringError>("Division by zero", inconvertibleErrorCode());
+}
+
+FunctionCaller::FunctionCaller(LLJIT &JIT,
+                               StringMap<FunctionSignature> &JITtedFunctions,
+                               ThreadSafeContext TSCtx,
+                               unsigned CompileThreshold, bool FastMath)
+    : JIT(JIT), JITtedFunctions(JITtedFunctions), TSCtx(std::move(TSCtx)),
+      FastMath(FastMath), CompileThreshold(CompileThreshold) {
+  SymbolMap Hooks;
+  Hooks[JIT.mangleAndIntern(CodeGen::getDivByZeroHookName())] = {
+      ExecutorAddr::fromPtr(&divByZeroHook),
+      JITSymbolFlags::Exported | JITSymbolFlags::Callable};
+  // The JITDylib is fresh, so the names cannot clash.
+  cantFail(JIT.getMainJITDylib().define(absoluteSymbols(std::move(Hooks))));
+}
+
+Expected<CalcValue> FunctionCaller::invoke(CallTrampolineFn Trampoline,
+                                           void *Fn, const ValueSlot *Args,
+                                           ValueType ResultTy) {
+  ValueSlot Ret;
+  DivByZero = false;
+  Trampoline(Fn, Args, &Ret);
+  if (DivByZero)
+    return divByZeroError();
+  return CalcValue{ResultTy, Ret};
+}
+
+Expected<FunctionCaller::CallTrampolineFn>
+FunctionCaller::getTrampoline(const FunctionSignature &Sig) {
+  std::lock_guard<std::mutex> Lock(TrampolineMutex);
+  std::string Key = Sig.getMangledName();
+  auto I = Trampolines.find(Key);
+  if (I != Trampolines.end())
+    return I->second;
+
+  // First call with this signature: compile its trampoline.
+  ThreadSafeModule TSM;
+  {
+    auto Lock = TSCtx.getLock();
+    auto M = std::make_unique<Module>("JIT calc.trampoline", *TSCtx.getContext());
+    M->setDataLayout(JIT.getDataLayout());
+    CodeGen().compileCallTrampoline(M.get(), Sig);
+    TSM = ThreadSafeModule(std::move(M), TSCtx);
+  }
+  if (auto Err = JIT.addIRModule(std::move(TSM)))
+    return std::move(Err);
+
+  auto Addr = JIT.lookup(CodeGen::getCallTrampolineName(Sig));
+  if (!Addr)
+    return Addr.takeError();
+  auto *Trampoline = Addr->toPtr<CallTrampolineFn>();
+  Trampolines[Key] = Trampoline;
+  return Trampoline;
+}
+
+Error FunctionCaller::compile(StringRef FnName, Definition &Def) {
+  {
+    std::shared_lock<std::shared_mutex> Lock(Mutex);
+    if (Def.Fn)
+      return Error::success();
+  }
+
+  // Looking the function up compiles it. The JIT is thread safe and
+  // compiles a module only once however many threads look it up, so neither
+  // this nor the trampoline holds up calls to other functions.
+  auto Trampoline = getTrampoline(Def.Sig);
+  if (!Trampoline)
+    return Trampoline.takeError();
+  auto Addr = JIT.lookup(FnName);
+  if (!Addr)
+    return Addr.takeError();
+
+  std::unique_lock<std::shared_mutex> Lock(Mutex);
+  Def.Trampoline = *Trampoline;
+  Def.Fn = Addr->toPtr<void *>();
+  return Error::success();
+}
+
+Expected<CalcValue> FunctionCaller::call(StringRef FnName,
+                                         ArrayRef<CalcValue> Args) {
+  SmallVector<ValueSlot, 8> Slots;
+  Definition *Def;
+  {
+    std::shared_lock<std::shared_mutex> Lock(Mutex);
+    auto I = Definitions.find(FnName);
+    if (I == Definitions.end())
+      return make_error<StringError>("Function " + FnName + " is not defined",
+                                     inconvertibleErrorCode());
+    Def = &I->second;
+    const FunctionSignature &Sig = Def->Sig;
+    if (Sig.getNumParams() != Args.size())
+      return make_error<StringError>("Function " + FnName + " takes " +
+                                         Twine(Sig.getNumParams()) +
+                                         " arguments",
+                                     inconvertibleErrorCode());
+    SmallVector<CalcValue, 8> Converted;
+    for (size_t I = 0, E = Args.size(); I != E; ++I) {
+      auto V = Args[I].convertTo(Sig.Params[I]);
+      if (!V)
+        return make_error<StringError>("Argument " + Args[I].toLiteral() +
+                                           " does not fit parameter " +
+                                           Twine(I + 1) + " of " + FnName,
+                                       inconvertibleErrorCode());
+      Converted.push_back(*V);
+      Slots.push_back(V->V);
+    }
+
+    if (Def->Fn)
+      return invoke(Def->Trampoline, Def->Fn, Slots.data(), Sig.Result);
+    if (Def->Constant)
+      return *Def->Constant;
+    if (Def->Calls.fetch_add(1, std::memory_order_relaxed) < CompileThreshold)
+      return Interpreter::evaluate(Def->Tree, Converted);
+  }
+
+  // Definitions are never removed, so Def stays valid without the lock.
+  if (auto Err = compile(FnName, *Def))
+    return std::move(Err);
+  CallTrampolineFn Trampoline;
+  void *Fn;
+  {
+    std::shared_lock<std::shared_mutex> Lock(Mutex);
+    Trampoline = Def->Trampoline;
+    Fn = Def->Fn;
+  }
+  return invoke(Trampoline, Fn, Slots.data(), Def->Sig.Result);
+}
+
+std::string FunctionCaller::getModuleName(StringRef FnName) {
+  return (ModulePrefix + FnName).str();
+}
+
+Error FunctionCaller::define(StringRef Source, bool DumpIR,
+                             std::unique_ptr<MemoryBuffer> Object) {
+  // The lexer relies on a terminating NUL, and the tree is kept for the
+  // interpreter, so the text needs a stable home.
+  auto Text = std::make_unique<std::string>(Source.str());
+  Lexer Lex(*Text);
+  Parser Parser(Lex);
+  AST *Tree = Parser.parse();
+  if (!Tree || Parser.hasError())
+    return make_error<StringError>("Syntax errors occured",
+                                   inconvertibleErrorCode());
+
+  // A definition only refers to its own signature, so it is checked and
+  // generated against a map of its own. Neither holds Mutex: generating IR
+  // waits for the context lock, which the JIT holds while it compiles, and
+  // calls must not wait for that.
+  StringMap<FunctionSignature> Sigs;
+  Sema Semantic;
+  if (Semantic.semantic(Tree, Sigs))
+    return make_error<StringError>("Semantic errors occured",
+                                   inconvertibleErrorCode());
+  std::optional<CalcValue> Constant = ConstantFolder().fold(Tree);
+  StringRef FnName = Tree->getFnName();
+  FunctionSignature Sig = static_cast<DefDecl *>(Tree)->getSignature();
+  // The JIT would reject the duplicate symbol only after the module has been
+  // built, so names are checked up front and again before adding it.
+  auto AlreadyDefined = [&]() {
+    return make_error<StringError>("Function " + FnName + " is already defined",
+                                   inconvertibleErrorCode());
+  };
+  {
+    std::shared_lock<std::shared_mutex> Lock(Mutex);
+    if (Definitions.count(FnName))
+      return AlreadyDefined();
+  }
+
+  ThreadSafeModule TSM;
+  if (!Object) {
+    auto CtxLock = TSCtx.getLock();
+    auto M = std::make_unique<Module>(getModuleName(FnName),
+                                      *TSCtx.getContext());
+    M->setDataLayout(JIT.getDataLayout());
+    // Generate the IR.
+    CodeGen(FastMath).compileToIR(Tree, M.get(), Sigs);
+    if (DumpIR)
+      M->print(outs(), nullptr);
+    TSM = ThreadSafeModule(std::move(M), TSCtx);
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> Lock(Mutex);
+    if (Definitions.count(FnName))
+      return AlreadyDefined();
+    // Adding only registers the code; it is compiled on first lookup.
+    if (auto Err = Object ? JIT.addObjectFile(std::move(Object))
+                          : JIT.addIRModule(std::move(TSM)))
+      return Err;
+    JITtedFunctions[FnName] = Sig;
+    Definitions.try_emplace(FnName, std::move(Text), Tree, Sig, Constant);
+  }
+
+  // Definitions loaded from the library are in its manifest already.
+  if (Lib && !Object)
+    if (auto Err = Lib->record(FnName, Sig.getNumParams(), Source))
+      return Err;
+  return Error::success();
+}
+
+Expected<TargetMachine *> FunctionCaller::getTargetMachine() {
+  if (!TM) {
+    auto JTMB = JITTargetMachineBuilder::detectHost();
+    if (!JTMB)
+      return JTMB.takeError();
+    auto HostTM = JTMB->createTargetMachine();
+    if (!HostTM)
+      return HostTM.takeError();
+    TM = std::move(*HostTM);
+  }
+  return TM.get();
+}
+
+unsigned FunctionCaller::getVectorWidth() {
+  if (VectorWidth)
+    return VectorWidth;
+
+  VectorWidth = 1;
+  auto HostTM = getTargetMachine();
+  if (!HostTM) {
+    consumeError(HostTM.takeError());
+    return VectorWidth;
+  }
+
+  // The register width only depends on the subtarget, so any function will do
+  // for asking the cost model.
+  LLVMContext Ctx;
+  Module M("JIT calc.width", Ctx);
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                 GlobalValue::ExternalLinkage, "width", M);
+  TypeSize Bits = (*HostTM)->getTargetTransformInfo(*F).getRegisterBitWidth(
+      TargetTransformInfo::RGK_FixedWidthVector);
+  VectorWidth = std::max<unsigned>(1, Bits.getFixedValue() / 32);
+  return VectorWidth;
+}
+
+Expected<FunctionCaller::BatchFn>
+FunctionCaller::getBatchFunc(StringRef FnName) {
+  auto I = BatchFuncs.find(FnName);
+  if (I != BatchFuncs.end())
+    return I->second;
+
+  auto Def = Definitions.find(FnName);
+  if (Def == Definitions.end())
+    return make_error<StringError>("Function " + FnName + " is not defined",
+                                   inconvertibleErrorCode());
+
+  auto HostTM = getTargetMachine();
+  if (!HostTM)
+    return HostTM.takeError();
+
+  if (!Def->second.Sig.isAllI32())
+    return make_error<StringError>("Function " + FnName +
+                                       " is not a function of i32",
+                                   inconvertibleErrorCode());
+
+  AST *Tree = Def->second.Tree;
+  unsigned Width = getVectorWidth();
+  ThreadSafeModule TSM;
+  {
+    auto Lock = TSCtx.getLock();
+    auto M = std::make_unique<Module>("JIT calc.batch", *TSCtx.getContext());
+    M->setDataLayout(JIT.getDataLayout());
+    M->setTargetTriple((*HostTM)->getTargetTriple().str());
+    CodeGen(FastMath).compileBatchFunc(Tree, M.get(), JITtedFunctions, Width);
+    CodeGen::optimize(M.get(), *HostTM, OptimizationLevel::O3);
+    TSM = ThreadSafeModule(std::move(M), TSCtx);
+  }
+  // Already optimized for the host, so skip the JIT's own IR transform.
+  if (auto Err = JIT.getIRCompileLayer().add(JIT.getMainJITDylib(),
+                                             std::move(TSM)))
+    return std::move(Err);
+
+  auto Addr = JIT.lookup(CodeGen::getBatchFuncName(FnName));
+  if (!Addr)
+    return Addr.takeError();
+  auto *Batch = Addr->toPtr<BatchFn>();
+  BatchFuncs[FnName] = Batch;
+  return Batch;
+}
+
+Error FunctionCaller::callBatch(StringRef FnName, ArrayRef<const int *> Columns,
+                                int *Out, size_t N) {
+  BatchFn Fn;
+  {
+    std::unique_lock<std::shared_mutex> Lock(Mutex);
+    auto Batch = getBatchFunc(FnName);
+    if (!Batch)
+      return Batch.takeError();
+    Fn = *Batch;
+  }
+
+  DivByZero = false;
+  Fn(Columns.data(), Out, N);
+  if (DivByZero)
+    return divByZeroError();
+  return Error::success();
+}
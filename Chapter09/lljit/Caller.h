@@ -0,0 +1,128 @@
+#ifndef CALLER_H
+#define CALLER_H
+
+#include "AST.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Target/TargetMachine.h"
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+
+// Calls user defined functions. Functions whose body folds to a constant are
+// answered without evaluating anything. The first CompileThreshold calls of
+// any other function are answered by the Interpreter; after that it is
+// compiled by the JIT. The compiled function's address is looked up once and the argument
+// values are passed at run time through a trampoline shared by all functions
+// of the same signature, so a call needs no IR generation or compilation.
+//
+// All members may be called concurrently: calls to functions that were called
+// before only take a shared lock. A function is compiled without holding the
+// lock, which is only taken exclusively to publish its address, so a cold
+// function does not stall calls to the others.
+class Library;
+
+class FunctionCaller {
+  using CallTrampolineFn = void (*)(void *Fn, const ValueSlot *Args,
+                                    ValueSlot *Ret);
+  using BatchFn = void (*)(const int *const *Cols, int *Out, int64_t N);
+
+  llvm::orc::LLJIT &JIT;
+  llvm::StringMap<FunctionSignature> &JITtedFunctions;
+  // Context that every module of the session is built in.
+  llvm::orc::ThreadSafeContext TSCtx;
+  // Whether floating point code is compiled with fast-math flags.
+  bool FastMath;
+  // Guards JITtedFunctions and all of the caches below but Trampolines.
+  std::shared_mutex Mutex;
+  // Held while a trampoline is compiled, so that each is added only once.
+  std::mutex TrampolineMutex;
+  // Keyed by FunctionSignature::getMangledName().
+  llvm::StringMap<CallTrampolineFn> Trampolines;
+
+  // A checked definition, interpreted while it is cold, called through its
+  // trampoline once it is compiled and compiled into batch loops on demand.
+  struct Definition {
+    // Owns the text that Tree refers to.
+    std::unique_ptr<std::string> Source;
+    AST *Tree;
+    FunctionSignature Sig;
+    // The value of the body if it is constant.
+    std::optional<CalcValue> Constant;
+    std::atomic<unsigned> Calls{0};
+    // Set once the function has been compiled and looked up.
+    void *Fn = nullptr;
+    CallTrampolineFn Trampoline = nullptr;
+
+    Definition(std::unique_ptr<std::string> Source, AST *Tree,
+               FunctionSignature Sig, std::optional<CalcValue> Constant)
+        : Source(std::move(Source)), Tree(Tree), Sig(std::move(Sig)),
+          Constant(Constant) {}
+  };
+
+  llvm::StringMap<Definition> Definitions;
+  unsigned CompileThreshold;
+  Library *Lib = nullptr;
+  llvm::StringMap<BatchFn> BatchFuncs;
+  // Host machine used to optimize batch loops for its vector width.
+  std::unique_ptr<llvm::TargetMachine> TM;
+  unsigned VectorWidth = 0;
+
+  // The following require Mutex to be held exclusively.
+  llvm::Expected<llvm::TargetMachine *> getTargetMachine();
+  // Number of i32 lanes in the host's vector registers, or 1 if it has none.
+  unsigned getVectorWidth();
+  llvm::Expected<BatchFn> getBatchFunc(llvm::StringRef FnName);
+
+  // The following must be called without holding Mutex.
+  llvm::Expected<CallTrampolineFn>
+  getTrampoline(const FunctionSignature &Sig);
+  // Compiles and looks up Def's function and trampoline unless that was
+  // done already.
+  llvm::Error compile(llvm::StringRef FnName, Definition &Def);
+
+  // Calls Fn through Trampoline and reports an integer division by zero in
+  // it like the Interpreter does.
+  static llvm::Expected<CalcValue> invoke(CallTrampolineFn Trampoline,
+                                          void *Fn, const ValueSlot *Args,
+                                          ValueType ResultTy);
+
+public:
+  // Defines the runtime hooks of the compiled code in JIT's main JITDylib.
+  FunctionCaller(llvm::orc::LLJIT &JIT,
+                 llvm::StringMap<FunctionSignature> &JITtedFunctions,
+                 llvm::orc::ThreadSafeContext TSCtx,
+                 unsigned CompileThreshold = 0, bool FastMath = false);
+
+  // Prefix of the names of the modules holding definitions.
+  static constexpr llvm::StringLiteral ModulePrefix = "calc.def.";
+  static std::string getModuleName(llvm::StringRef FnName);
+
+  // New definitions are recorded in Lib from now on.
+  void setLibrary(Library *L) { Lib = L; }
+
+  // Parses, checks and compiles a "def" line and records its source. With
+  // DumpIR the generated module is printed to stdout. With Object, the code
+  // compiled for the definition earlier is added instead of generating it.
+  // Functions cannot be redefined.
+  llvm::Error define(llvm::StringRef Source, bool DumpIR = false,
+                     std::unique_ptr<llvm::MemoryBuffer> Object = nullptr);
+
+  // Converts Args to the parameter types of FnName and calls it. Fails if
+  // FnName is not defined, takes a different number of arguments or an
+  // argument does not convert without narrowing. The result has the
+  // function's result type.
+  llvm::Expected<CalcValue> call(llvm::StringRef FnName,
+                                 llvm::ArrayRef<CalcValue> Args);
+
+  // Computes Out[i] = FnName(Columns[0][i], ...) for all i < N with a JIT'd
+  // loop over the function's SIMD variant. Columns must hold one column per
+  // argument. Only functions of i32 can be evaluated this way.
+  llvm::Error callBatch(llvm::StringRef FnName,
+                        llvm::ArrayRef<const int *> Columns, int *Out,
+                        size_t N);
+};
+
+#endif
@@ -1,59 +1,171 @@
 #include "CodeGen.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 
 namespace {
 
+// i32, i64 or double, or a vector of VectorWidth of them if that is not 0.
+Type *getLLVMType(LLVMContext &Ctx, ValueType Ty, unsigned VectorWidth = 0) {
+    Type *T = Ty == ValueType::F64   ? Type::getDoubleTy(Ctx)
+              : Ty == ValueType::I64 ? Type::getInt64Ty(Ctx)
+                                     : Type::getInt32Ty(Ctx);
+    return VectorWidth ? FixedVectorType::get(T, VectorWidth) : T;
+}
+
 class ToIRVisitor : public ASTVisitor {
     Module *M;
     IRBuilder<> Builder;
-    StringMap<size_t> &JITtedFunctionsMap;
-    Type *Int32Ty;
+    StringMap<FunctionSignature> &JITtedFunctionsMap;
+    // Lanes of the SIMD variant being emitted, or 0 for the scalar function.
+    // Only functions of i32 have SIMD variants.
+    unsigned VectorWidth;
 
     Value *V;
     StringMap<Value *> nameMap;
 
 public:
     ToIRVisitor(Module *M, 
-                StringMap<size_t> &JITtedFunctions)
-                : M(M), Builder(M->getContext()),JITtedFunctionsMap(JITtedFunctions) {
-
-        Int32Ty = Type::getInt32Ty(M->getContext());
+                StringMap<FunctionSignature> &JITtedFunctions,
+                unsigned VectorWidth = 0, bool FastMath = false)
+                : M(M), Builder(M->getContext()),JITtedFunctionsMap(JITtedFunctions),
+                  VectorWidth(VectorWidth) {
+        if (FastMath)
+            Builder.setFastMathFlags(FastMathFlags::getFast());
     }
 
-    void genFuncEvaluationCall(AST *Tree) { Tree->accept(*this);}
-
     void run(AST *Tree) {
         Tree->accept(*this);
         Builder.CreateRet(V);
     }
 
+    Type *getType(ValueType Ty) {
+        return getLLVMType(M->getContext(), Ty, VectorWidth);
+    }
+
+    Value *convert(Value *Val, ValueType From, ValueType To) {
+        if (From == To)
+            return Val;
+        if (To == ValueType::F64)
+            return Builder.CreateSIToFP(Val, getType(To));
+        return Builder.CreateSExt(Val, getType(To));
+    }
+
     Function *genUserDefinedFunction(llvm::StringRef FnName) {
 
-        if(Function *FuncFromModule = M->getFunction(FnName))
+        std::string EmitName = VectorWidth
+                                   ? CodeGen::getVectorFuncName(FnName, VectorWidth)
+                                   : FnName.str();
+        if(Function *FuncFromModule = M->getFunction(EmitName))
           return FuncFromModule;
 
         Function *UserDefinedFunction = nullptr;
-        auto FnNameToArgCount = JITtedFunctionsMap.find(FnName);
-
-        if(FnNameToArgCount != JITtedFunctionsMap.end() ) {
-            std::vector<Type *> IntArgs(FnNameToArgCount->second,Int32Ty);
-            FunctionType *FuncType = FunctionType::get(Int32Ty,IntArgs,false);
-            UserDefinedFunction = Function::Create(FuncType, GlobalValue::ExternalLinage,FnName,M);
+        auto FnNameToSig = JITtedFunctionsMap.find(FnName);
+
+        if(FnNameToSig != JITtedFunctionsMap.end() ) {
+            std::vector<Type *> ArgTys;
+            for (ValueType Ty : FnNameToSig->second.Params)
+                ArgTys.push_back(getType(Ty));
+            FunctionType *FuncType =
+                FunctionType::get(getType(FnNameToSig->second.Result), ArgTys, false);
+            UserDefinedFunction = Function::Create(FuncType, GlobalValue::ExternalLinkage,EmitName,M);
         } 
         return UserDefinedFunction;
     }
 
+    virtual void visit(BinaryOp &Node) override {
+        ValueType Ty = Node.getType();
+        Node.getLeft()->accept(*this);
+        Value *Left = convert(V, Node.getLeft()->getType(), Ty);
+        Node.getRight()->accept(*this);
+        Value *Right = convert(V, Node.getRight()->getType(), Ty);
+        if (Ty == ValueType::F64) {
+            switch (Node.getOperator()) {
+            case BinaryOp::Plus:
+                V = Builder.CreateFAdd(Left, Right);
+                break;
+            case BinaryOp::Minus:
+                V = Builder.CreateFSub(Left, Right);
+                break;
+            case BinaryOp::Mul:
+                V = Builder.CreateFMul(Left, Right);
+                break;
+            case BinaryOp::Div:
+                V = Builder.CreateFDiv(Left, Right);
+                break;
+            }
+            return;
+        }
+        // Integer arithmetic wraps, as in the Interpreter.
+        switch (Node.getOperator()) {
+        case BinaryOp::Plus:
+            V = Builder.CreateAdd(Left, Right);
+            break;
+        case BinaryOp::Minus:
+            V = Builder.CreateSub(Left, Right);
+            break;
+        case BinaryOp::Mul:
+            V = Builder.CreateMul(Left, Right);
+            break;
+        case BinaryOp::Div:
+            V = createCheckedSDiv(Left, Right);
+            break;
+        }
+    }
+
+    // Divides without trapping: MIN / -1 wraps to MIN and x / 0 calls the
+    // division by zero hook (see CodeGen::getDivByZeroHookName()). Both divide
+    // by 1 instead, which yields the wrapped result for the former.
+    Value *createCheckedSDiv(Value *Left, Value *Right) {
+        LLVMContext &Ctx = M->getContext();
+        Type *Ty = Left->getType();
+        unsigned Bits = Ty->getScalarSizeInBits();
+        Value *IsZero = Builder.CreateICmpEQ(Right, ConstantInt::get(Ty, 0));
+        Value *Overflows = Builder.CreateAnd(
+            Builder.CreateICmpEQ(Left, ConstantInt::get(Ty, APInt::getSignedMinValue(Bits))),
+            Builder.CreateICmpEQ(Right, ConstantInt::getAllOnesValue(Ty)));
+        Value *Divisor = Builder.CreateSelect(Builder.CreateOr(IsZero, Overflows),
+                                              ConstantInt::get(Ty, 1), Right);
+
+        Function *F = Builder.GetInsertBlock()->getParent();
+        BasicBlock *ZeroBB = BasicBlock::Create(Ctx, "div.zero", F);
+        BasicBlock *ContBB = BasicBlock::Create(Ctx, "div.cont", F);
+        Value *AnyZero = VectorWidth ? Builder.CreateOrReduce(IsZero) : IsZero;
+        Builder.CreateCondBr(AnyZero, ZeroBB, ContBB);
+
+        Builder.SetInsertPoint(ZeroBB);
+        FunctionCallee Hook = M->getOrInsertFunction(
+            CodeGen::getDivByZeroHookName(), Type::getVoidTy(Ctx));
+        Builder.CreateCall(Hook);
+        Builder.CreateBr(ContBB);
+
+        Builder.SetInsertPoint(ContBB);
+        return Builder.CreateSDiv(Left, Divisor);
+    }
+
     virtual void visit(Factor &Node) override {
         if (Node.getKind() == Factor::Ident) {
             V = nameMap[Node.getVal()];
 
         } else {
-            int intval;
-            Node.getVal().getAsInteger(10,intval);
-            V = ConstantInt::get(Int32Ty, intval, true);
+            // Folded constants may be written in a narrower type than the
+            // one Sema gave them.
+            CalcValue Val = *CalcValue::parse(Node.getVal())->convertTo(Node.getType());
+            // Splatted across all lanes for the SIMD variant.
+            Type *Ty = getType(Node.getType());
+            switch (Val.Ty) {
+            case ValueType::I32:
+                V = ConstantInt::get(Ty, Val.V.I32, true);
+                break;
+            case ValueType::I64:
+                V = ConstantInt::get(Ty, Val.V.I64, true);
+                break;
+            case ValueType::F64:
+                V = ConstantFP::get(Ty, Val.V.F64);
+                break;
+            }
         }
     }
 
@@ -62,7 +174,7 @@ public:
         llvm::StringRef FnName = Node.getFnName();
         llvm::SmallVector<llvm::StringRef, 8> FunctionVars = Node.getVars();
 
-        (JITtedFunctionsMap)[FnName] = FunctionVars.size();
+        (JITtedFunctionsMap)[FnName] = Node.getSignature();
 
         Function *DefFunc = genUserDefinedFunction(FnName);
         if(!DefFunc) {
@@ -86,52 +198,192 @@ public:
     }
 
 
-    virtual void visit(FuncCallFromDef &Node) override {
-        llvm::StringRef CalcExprFunName = "calc_expr_func";
+    // Calls are not lowered to IR: they invoke the already compiled function
+    // through a call trampoline (see CodeGen::compileCallTrampoline).
+    virtual void visit(FuncCallFromDef &Node) override {}
 
-        FunctionType *CalcExprFunTy = FunctionType::get(Int32Ty, {}, false);
-        Function *CalcExprFun = Function::Create(CalcExprFunTy, GlobalValue::ExternalLinkage, CalcEprFunName, M);
+};    
+}//namespace
 
-        BasicBlock *BB = BasicBlock::Create(M->getContext(),"entry", CalcExprFun);
-        Builder.SetInsertPoint(BB);
 
-        llvm::StringRef CalleeFnName = Node.getFnName();
-        Function *CalleeFn = genUserDefinedFunction(CalleeFnName);
+void CodeGen::compileToIR(AST *Tree, Module *M,StringMap<FunctionSignature> &JITtedFunctions) {
+    ToIRVisitor ToIR(M,JITtedFunctions, 0, FastMath);
 
-        if(!CalleeFn){
-            llvm::errs() << "Cannot retrieve the original callee function!\n";
-            return;
-        }
-
-        auto CalleeFnVars = Node.getArgs();
-        llvm::SmallVector<Value *> IntParams;
+    ToIR.run(Tree);
+}
 
-        for(unsigned i = 0, end = CalleeFnVars.size(); i != end; ++i){
-            int ArgsToIntType;
-            CalleeFnVars[i].getAsInteger(10, ArgsToIntType);
-            Value *IntParam = ConstantInt::get(Int32Ty, ArgsToIntType, true);
-            IntParams.push_back(IntParam);
+std::string CodeGen::getVectorFuncName(llvm::StringRef FnName, unsigned VectorWidth) {
+    return (FnName + "_v" + Twine(VectorWidth)).str();
+}
 
-        }
+llvm::StringRef CodeGen::getDivByZeroHookName() {
+    return "calc_div_by_zero";
+}
 
-        Value *Res = Builder.CreateCall(CalleeFn,IntParams, "calc_expr_res");
-        Builder.CreateRet(Res);
-    };
+std::string CodeGen::getCallTrampolineName(const FunctionSignature &Sig) {
+    return "calc_call_" + Sig.getMangledName();
+}
 
-};    
-}//namespace
+void CodeGen::compileCallTrampoline(Module *M, const FunctionSignature &Sig) {
+    LLVMContext &Ctx = M->getContext();
+    IRBuilder<> Builder(Ctx);
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    PointerType *PtrTy = PointerType::getUnqual(Ctx);
+
+    // void calc_call_<sig>(ptr %fn, ptr %args, ptr %ret) loads the arguments
+    // from the 8 byte slots args[0..N), calls fn with them and stores the
+    // result to the slot at ret.
+    std::vector<Type *> ArgTys;
+    for (ValueType Ty : Sig.Params)
+        ArgTys.push_back(getLLVMType(Ctx, Ty));
+    Type *ResultTy = getLLVMType(Ctx, Sig.Result);
+    FunctionType *CalleeTy = FunctionType::get(ResultTy, ArgTys, false);
+    FunctionType *TrampolineTy =
+        FunctionType::get(Type::getVoidTy(Ctx), {PtrTy, PtrTy, PtrTy}, false);
+    Function *Trampoline = Function::Create(TrampolineTy, GlobalValue::ExternalLinkage,
+                                            getCallTrampolineName(Sig), M);
+
+    BasicBlock *BB = BasicBlock::Create(Ctx, "entry", Trampoline);
+    Builder.SetInsertPoint(BB);
+
+    Value *Callee = Trampoline->getArg(0);
+    Value *Args = Trampoline->getArg(1);
+    llvm::SmallVector<Value *, 8> CallArgs;
+    for (unsigned I = 0, E = ArgTys.size(); I != E; ++I) {
+        Value *ArgPtr = Builder.CreateConstInBoundsGEP1_32(Int64Ty, Args, I);
+        CallArgs.push_back(Builder.CreateAlignedLoad(ArgTys[I], ArgPtr, Align(8)));
+    }
 
+    Value *Result = Builder.CreateCall(CalleeTy, Callee, CallArgs);
+    Builder.CreateAlignedStore(Result, Trampoline->getArg(2), Align(8));
+    Builder.CreateRetVoid();
+}
 
-void CodeGen::compileToIR(AST *Tree, Module *M,StringMap<size_t> &JITtedFunctions) {
-    ToIRVisitor ToIR(M,JITtedFunctions);
+std::string CodeGen::getBatchFuncName(llvm::StringRef FnName) {
+    return ("calc_batch_" + FnName).str();
+}
 
+void CodeGen::compileBatchFunc(AST *Tree, Module *M,
+                               StringMap<FunctionSignature> &JITtedFunctions,
+                               unsigned VectorWidth) {
+    // Private copies of the user function and of its SIMD variant, always
+    // inlined into the loops below.
+    ToIRVisitor ToIR(M, JITtedFunctions, 0, FastMath);
     ToIR.run(Tree);
-    M->print(outs(),nullptr);
+    llvm::StringRef FnName = Tree->getFnName();
+    Function *Fn = M->getFunction(FnName);
+    Fn->setLinkage(GlobalValue::InternalLinkage);
+    Fn->addFnAttr(Attribute::AlwaysInline);
+
+    Function *VecFn = nullptr;
+    if (VectorWidth > 1) {
+        ToIRVisitor ToVectorIR(M, JITtedFunctions, VectorWidth, FastMath);
+        ToVectorIR.run(Tree);
+        VecFn = M->getFunction(getVectorFuncName(FnName, VectorWidth));
+        VecFn->setLinkage(GlobalValue::InternalLinkage);
+        VecFn->addFnAttr(Attribute::AlwaysInline);
+    }
+
+    LLVMContext &Ctx = M->getContext();
+    IRBuilder<> Builder(Ctx);
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    PointerType *PtrTy = PointerType::getUnqual(Ctx);
+
+    FunctionType *BatchTy =
+        FunctionType::get(Type::getVoidTy(Ctx), {PtrTy, PtrTy, Int64Ty}, false);
+    Function *Batch = Function::Create(BatchTy, GlobalValue::ExternalLinkage,
+                                       getBatchFuncName(FnName), M);
+    // The output buffer never overlaps the argument columns.
+    Batch->addParamAttr(1, Attribute::NoAlias);
+
+    Value *Cols = Batch->getArg(0);
+    Value *Out = Batch->getArg(1);
+    Value *N = Batch->getArg(2);
+
+    BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Batch);
+    BasicBlock *VecLoop = VecFn ? BasicBlock::Create(Ctx, "vec.loop", Batch) : nullptr;
+    BasicBlock *Tail = BasicBlock::Create(Ctx, "tail", Batch);
+    BasicBlock *Loop = BasicBlock::Create(Ctx, "loop", Batch);
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", Batch);
+
+    Builder.SetInsertPoint(Entry);
+    llvm::SmallVector<Value *, 8> ColPtrs;
+    for (unsigned I = 0, E = Fn->arg_size(); I != E; ++I) {
+        Value *ColPtr = Builder.CreateConstInBoundsGEP1_32(PtrTy, Cols, I);
+        ColPtrs.push_back(Builder.CreateLoad(PtrTy, ColPtr));
+    }
 
+    // Whole vectors go through the SIMD variant: for (i = 0; i < NVec; i += W)
+    Value *NVec = ConstantInt::get(Int64Ty, 0);
+    if (VecFn) {
+        NVec = Builder.CreateAnd(N, ConstantInt::get(Int64Ty, -int64_t(VectorWidth)), "n.vec");
+        Builder.CreateCondBr(Builder.CreateICmpSGT(NVec, ConstantInt::get(Int64Ty, 0)),
+                             VecLoop, Tail);
+
+        Builder.SetInsertPoint(VecLoop);
+        Type *VecTy = FixedVectorType::get(Int32Ty, VectorWidth);
+        PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "vi");
+        Idx->addIncoming(ConstantInt::get(Int64Ty, 0), Entry);
+        llvm::SmallVector<Value *, 8> Args;
+        for (Value *Col : ColPtrs)
+            Args.push_back(Builder.CreateAlignedLoad(
+                VecTy, Builder.CreateInBoundsGEP(Int32Ty, Col, Idx), Align(4)));
+        Value *Res = Builder.CreateCall(VecFn, Args);
+        Builder.CreateAlignedStore(Res, Builder.CreateInBoundsGEP(Int32Ty, Out, Idx),
+                                   Align(4));
+        Value *Next = Builder.CreateNSWAdd(Idx, ConstantInt::get(Int64Ty, VectorWidth));
+        Idx->addIncoming(Next, VecLoop);
+        Builder.CreateCondBr(Builder.CreateICmpSLT(Next, NVec), VecLoop, Tail);
+    } else {
+        Builder.CreateBr(Tail);
+    }
+
+    // The remaining elements go through the scalar function:
+    // for (i = NVec; i < N; ++i)
+    Builder.SetInsertPoint(Tail);
+    Builder.CreateCondBr(Builder.CreateICmpSLT(NVec, N), Loop, Exit);
+
+    Builder.SetInsertPoint(Loop);
+    PHINode *Idx = Builder.CreatePHI(Int64Ty, 2, "i");
+    Idx->addIncoming(NVec, Tail);
+    llvm::SmallVector<Value *, 8> Args;
+    for (Value *Col : ColPtrs)
+        Args.push_back(Builder.CreateLoad(Int32Ty, Builder.CreateInBoundsGEP(Int32Ty, Col, Idx)));
+    Value *Res = Builder.CreateCall(Fn, Args);
+    Builder.CreateStore(Res, Builder.CreateInBoundsGEP(Int32Ty, Out, Idx));
+    Value *Next = Builder.CreateNSWAdd(Idx, ConstantInt::get(Int64Ty, 1));
+    Idx->addIncoming(Next, Loop);
+    Instruction *Latch = Builder.CreateCondBr(Builder.CreateICmpSLT(Next, N), Loop, Exit);
+    if (VecFn) {
+        // At most VectorWidth - 1 iterations, not worth vectorizing again.
+        MDNode *NoVectorize = MDNode::get(
+            Ctx, {MDString::get(Ctx, "llvm.loop.vectorize.enable"),
+                  ConstantAsMetadata::get(Builder.getFalse())});
+        MDNode *LoopID = MDNode::getDistinct(Ctx, {nullptr, NoVectorize});
+        LoopID->replaceOperandWith(0, LoopID);
+        Latch->setMetadata(LLVMContext::MD_loop, LoopID);
+    }
+
+    Builder.SetInsertPoint(Exit);
+    Builder.CreateRetVoid();
 }
 
-void CodeGen::prepareCalculationCallFunc(AST *FuncCall, Module *M, llvm::StringRef FnName, StringMap<size_t> &JITtedFunctions) {
-    ToIRVisitor ToIR(M, JITtedFunctions);
-    ToIR.genFuncEvaluationCall(FuncCall);
-    M->print(outs(),nullptr);
-}
\ No newline at end of file
+void CodeGen::optimize(Module *M, TargetMachine *TM, OptimizationLevel Level) {
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PassBuilder PB(TM);
+
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    ModulePassManager MPM = Level == OptimizationLevel::O0
+                                ? PB.buildO0DefaultPipeline(Level)
+                                : PB.buildPerModuleDefaultPipeline(Level);
+    MPM.run(*M, MAM);
+}
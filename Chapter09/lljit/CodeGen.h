@@ -4,18 +4,56 @@
 #include "AST.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Target/TargetMachine.h"
 
 using namespace llvm;
 
 class CodeGen {
+    // Whether floating point operations carry fast-math flags.
+    bool FastMath;
 
 public:
+    CodeGen(bool FastMath = false) : FastMath(FastMath) {}
+
+
     void compileToIR(
-        AST *Tree,Module *M, StringMap<size_t> &JITtedFunction);
+        AST *Tree,Module *M, StringMap<FunctionSignature> &JITtedFunction);
+
+    // Name of the SIMD variant of a function of i32 that compileBatchFunc()
+    // emits, which takes and returns <VectorWidth x i32>.
+    static std::string getVectorFuncName(llvm::StringRef FnName, unsigned VectorWidth);
+
+    // Name of the `void()` function that compiled code calls when it divides
+    // an integer by zero. The division itself yields the dividend instead of
+    // trapping.
+    static llvm::StringRef getDivByZeroHookName();
+
+    // Name of the trampoline emitted by compileCallTrampoline().
+    static std::string getCallTrampolineName(const FunctionSignature &Sig);
+
+    // Emits a function that calls a user defined function of signature Sig,
+    // given its address, a pointer to the argument slots and one to the
+    // result slot (see ValueSlot). One trampoline per signature serves every
+    // function with that signature.
+    void compileCallTrampoline(Module *M, const FunctionSignature &Sig);
+
+    // Name of the loop wrapper emitted by compileBatchFunc().
+    static std::string getBatchFuncName(llvm::StringRef FnName);
+
+    // Emits `void calc_batch_<fn>(ptr cols, ptr out, i64 n)`, which computes
+    // out[i] = fn(cols[0][i], ..., cols[k][i]) for every i < n. The body of
+    // the definition Tree is emitted into the same module so that it can be
+    // inlined. With VectorWidth > 1, whole vectors of rows are computed by the
+    // SIMD variant and only the tail by the scalar function. The function
+    // must be of i32.
+    void compileBatchFunc(AST *Tree, Module *M,
+                          StringMap<FunctionSignature> &JITtedFunctions,
+                          unsigned VectorWidth = 0);
 
-    void prepareCalculationCallFunc(
-        AST *FuncCall, Module *M, llvm::StringRef FnName, 
-        StringMap<size_t> &JITtedFunctions);  
+    // Runs the default module pipeline for Level. With a TargetMachine the
+    // cost models (e.g. of the loop vectorizer) know the host's vector width.
+    static void optimize(Module *M, TargetMachine *TM, OptimizationLevel Level);
 };
 
 #endif
\ No newline at end of file
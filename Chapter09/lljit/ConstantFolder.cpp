@@ -0,0 +1,56 @@
+#include "ConstantFolder.h"
+#include "Interpreter.h"
+
+namespace {
+class FoldVisitor : public ASTVisitor {
+  // Set by visiting an expression: its value if it is constant, and the
+  // node to replace it with if that is a new one.
+  std::optional<CalcValue> Value;
+  Expr *Folded = nullptr;
+
+public:
+  std::optional<CalcValue> getValue() const { return Value; }
+
+  Expr *fold(Expr *E, std::optional<CalcValue> &Val) {
+    Value.reset();
+    Folded = nullptr;
+    E->accept(*this);
+    Val = Value;
+    return Folded ? Folded : E;
+  }
+
+  virtual void visit(Factor &Node) override {
+    if (Node.getKind() == Factor::Number)
+      if (auto V = CalcValue::parse(Node.getVal()))
+        Value = V->convertTo(Node.getType());
+  }
+
+  virtual void visit(BinaryOp &Node) override {
+    std::optional<CalcValue> Left, Right;
+    Node.setLeft(fold(Node.getLeft(), Left));
+    Node.setRight(fold(Node.getRight(), Right));
+    Value.reset();
+    Folded = nullptr;
+    if (!Left || !Right)
+      return;
+    ValueType Ty = Node.getType();
+    if ((Value = Interpreter::applyOp(Node.getOperator(), *Left->convertTo(Ty),
+                                      *Right->convertTo(Ty))))
+      Folded = new Factor(*Value);
+  }
+
+  virtual void visit(DefDecl &Node) override {
+    std::optional<CalcValue> Body;
+    Node.setExpr(fold(Node.getExpr(), Body));
+    Value = Body;
+  }
+
+  virtual void visit(FuncCallFromDef &Node) override {}
+};
+} // namespace
+
+std::optional<CalcValue> ConstantFolder::fold(AST *Tree) {
+  FoldVisitor Folder;
+  Tree->accept(Folder);
+  return Folder.getValue();
+}
@@ -0,0 +1,17 @@
+#ifndef CONSTANTFOLDER_H
+#define CONSTANTFOLDER_H
+
+#include "AST.h"
+#include <optional>
+
+// Replaces every BinaryOp whose operands are numbers, once they have been
+// folded themselves, by the number it evaluates to in the type Sema gave it.
+// An integer division by zero is left in place for run time.
+class ConstantFolder {
+public:
+  // Folds the checked definition Tree in place. Returns the value of its
+  // body if that folded to a number, i.e. if the function is a constant.
+  std::optional<CalcValue> fold(AST *Tree);
+};
+
+#endif
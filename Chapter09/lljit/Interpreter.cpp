@@ -0,0 +1,116 @@
+#include "Interpreter.h"
+#include <cstdint>
+#include <limits>
+
+using namespace llvm;
+
+namespace {
+class EvalVisitor : public ASTVisitor {
+  // Parameters are few, so a linear scan beats hashing.
+  SmallVector<std::pair<StringRef, CalcValue>, 8> Env;
+  ArrayRef<CalcValue> Args;
+  CalcValue Result;
+  bool DivByZero = false;
+
+public:
+  EvalVisitor(ArrayRef<CalcValue> Args) : Args(Args) {}
+
+  Expected<CalcValue> run(AST *Tree) {
+    Tree->accept(*this);
+    if (DivByZero)
+      return make_error<StringError>("Division by zero",
+                                     inconvertibleErrorCode());
+    return Result;
+  }
+
+  virtual void visit(Factor &Node) override {
+    if (Node.getKind() == Factor::Number) {
+      // Folded constants may be written in a narrower type than the one
+      // Sema gave them.
+      Result = *CalcValue::parse(Node.getVal())->convertTo(Node.getType());
+      return;
+    }
+    for (auto &Binding : Env)
+      if (Binding.first == Node.getVal()) {
+        Result = Binding.second;
+        return;
+      }
+  }
+
+  virtual void visit(BinaryOp &Node) override {
+    ValueType Ty = Node.getType();
+    Node.getLeft()->accept(*this);
+    CalcValue Left = *Result.convertTo(Ty);
+    Node.getRight()->accept(*this);
+    if (auto V = Interpreter::applyOp(Node.getOperator(), Left,
+                                      *Result.convertTo(Ty)))
+      Result = *V;
+    else
+      DivByZero = true;
+  }
+
+  virtual void visit(DefDecl &Node) override {
+    size_t I = 0;
+    for (auto V = Node.begin(), E = Node.end(); V != E; ++V)
+      Env.push_back({*V, Args[I++]});
+    Node.getExpr()->accept(*this);
+  }
+
+  virtual void visit(FuncCallFromDef &Node) override {}
+};
+
+template <typename T>
+std::optional<T> applyIntOp(BinaryOp::Operator Op, T Left, T Right) {
+  using U = std::make_unsigned_t<T>;
+  U L = Left, R = Right;
+  switch (Op) {
+  case BinaryOp::Plus:
+    return T(L + R);
+  case BinaryOp::Minus:
+    return T(L - R);
+  case BinaryOp::Mul:
+    return T(L * R);
+  case BinaryOp::Div:
+    if (Right == 0)
+      return std::nullopt;
+    if (Left == std::numeric_limits<T>::min() && Right == -1)
+      return Left;
+    return Left / Right;
+  }
+  return std::nullopt;
+}
+} // namespace
+
+std::optional<CalcValue> Interpreter::applyOp(BinaryOp::Operator Op,
+                                              CalcValue Left,
+                                              CalcValue Right) {
+  switch (Left.Ty) {
+  case ValueType::I32:
+    if (auto V = applyIntOp(Op, Left.V.I32, Right.V.I32))
+      return CalcValue::getI32(*V);
+    return std::nullopt;
+  case ValueType::I64:
+    if (auto V = applyIntOp(Op, Left.V.I64, Right.V.I64))
+      return CalcValue::getI64(*V);
+    return std::nullopt;
+  case ValueType::F64:
+    break;
+  }
+  double L = Left.V.F64, R = Right.V.F64;
+  switch (Op) {
+  case BinaryOp::Plus:
+    return CalcValue::getF64(L + R);
+  case BinaryOp::Minus:
+    return CalcValue::getF64(L - R);
+  case BinaryOp::Mul:
+    return CalcValue::getF64(L * R);
+  case BinaryOp::Div:
+    return CalcValue::getF64(L / R);
+  }
+  return std::nullopt;
+}
+
+Expected<CalcValue> Interpreter::evaluate(AST *Tree,
+                                          ArrayRef<CalcValue> Args) {
+  return EvalVisitor(Args).run(Tree);
+}
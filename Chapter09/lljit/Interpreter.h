@@ -0,0 +1,29 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "AST.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include <optional>
+
+// Evaluates user defined functions by walking their AST. Answering a call
+// this way takes well under a microsecond, against milliseconds for compiling
+// the function, so functions are interpreted until they are called often
+// enough to be worth compiling.
+class Interpreter {
+public:
+  // Evaluates the checked definition Tree with Args, already converted to
+  // the parameter types, bound to its parameters in order. Integer
+  // arithmetic wraps, including MIN / -1; integer division by zero is
+  // reported instead of trapping. The compiled code (see CodeGen) does the
+  // same, so a function gives the same results in either tier.
+  static llvm::Expected<CalcValue> evaluate(AST *Tree,
+                                            llvm::ArrayRef<CalcValue> Args);
+
+  // Applies Op to two values of the same type as evaluate() does; nothing on
+  // integer division by zero.
+  static std::optional<CalcValue> applyOp(BinaryOp::Operator Op,
+                                          CalcValue Left, CalcValue Right);
+};
+
+#endif
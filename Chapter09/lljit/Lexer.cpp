@@ -32,8 +32,9 @@ void Lexer::next(Token &token) {
     return;
   }
   if (charinfo::isLetter(*BufferPtr)) {
+    // Letters and digits, so that type names such as i64 are identifiers.
     const char *end = BufferPtr + 1;
-    while (charinfo::isLetter(*end))
+    while (charinfo::isLetter(*end) || charinfo::isDigit(*end))
       ++end;
     llvm::StringRef Name(BufferPtr, end - BufferPtr);
     Token::TokenKind kind;
@@ -47,6 +48,12 @@ void Lexer::next(Token &token) {
     const char *end = BufferPtr + 1;
     while (charinfo::isDigit(*end))
       ++end;
+    // An optional fraction makes it an f64 literal.
+    if (*end == '.' && charinfo::isDigit(end[1])) {
+      end += 2;
+      while (charinfo::isDigit(*end))
+        ++end;
+    }
     formToken(token, end, Token::number);
     return;
   } else {
@@ -0,0 +1,114 @@
+#include "Library.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/Path.h"
+#include "llvm/TargetParser/Host.h"
+
+using namespace llvm;
+
+// Objects fit only the host and the code generation options they were
+// compiled for, so the header names both.
+static std::string getHeader(unsigned OptLevel, bool FastMath) {
+  return ("calc-library " + sys::getProcessTriple() + " " +
+          sys::getHostCPUName() + " O" + Twine(OptLevel) +
+          (FastMath ? " fast-math" : " strict-fp"))
+      .str();
+}
+
+Expected<std::unique_ptr<Library>> Library::open(StringRef Dir,
+                                                 unsigned OptLevel,
+                                                 bool FastMath) {
+  if (std::error_code EC = sys::fs::create_directories(Dir))
+    return createFileError(Dir, EC);
+  std::unique_ptr<Library> Lib(new Library(Dir));
+
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, "manifest");
+  std::string Header = getHeader(OptLevel, FastMath);
+  if (auto Buf = MemoryBuffer::getFile(Path, /*IsText=*/true)) {
+    Lib->Contents = std::move(*Buf);
+    StringRef First = Lib->Contents->getBuffer().split('\n').first;
+    if (First != Header) {
+      errs() << "warning: " << Path
+             << " was written on another host or with other code "
+                "generation options; its definitions will be recompiled\n";
+      Lib->UseObjects = false;
+    }
+  }
+
+  std::error_code EC;
+  Lib->Manifest = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Append);
+  if (EC)
+    return createFileError(Path, EC);
+  if (!Lib->Contents || Lib->Contents->getBufferSize() == 0) {
+    *Lib->Manifest << Header << "\n";
+    Lib->Manifest->flush();
+  }
+  return std::move(Lib);
+}
+
+std::string Library::getObjectPath(StringRef FnName) const {
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, FnName + ".o");
+  return std::string(Path);
+}
+
+Error Library::load(FunctionCaller &Caller) {
+  if (!Contents)
+    return Error::success();
+
+  unsigned Loaded = 0, Precompiled = 0;
+  line_iterator Line(*Contents, /*SkipBlanks=*/true);
+  // Skip the host line.
+  if (!Line.is_at_eof())
+    ++Line;
+  for (; !Line.is_at_eof(); ++Line) {
+    StringRef FnName, Rest, Arity, Source;
+    std::tie(FnName, Rest) = Line->split('\t');
+    std::tie(Arity, Source) = Rest.split('\t');
+    if (FnName.empty() || Source.empty())
+      return createStringError(inconvertibleErrorCode(),
+                               "Malformed line " + Twine(Line.line_number()) +
+                                   " in the manifest of " + Dir);
+
+    std::unique_ptr<MemoryBuffer> Object;
+    if (UseObjects) {
+      auto Buf = MemoryBuffer::getFile(getObjectPath(FnName));
+      if (Buf)
+        Object = std::move(*Buf);
+    }
+    Precompiled += Object != nullptr;
+    if (Error Err = Caller.define(Source, /*DumpIR=*/false, std::move(Object)))
+      return createStringError(inconvertibleErrorCode(),
+                               "Could not load " + FnName + " from " + Dir +
+                                   ": " + toString(std::move(Err)));
+    ++Loaded;
+  }
+  errs() << "Loaded " << Loaded << " definitions (" << Precompiled
+         << " precompiled) from " << Dir << "\n";
+  return Error::success();
+}
+
+Error Library::record(StringRef FnName, size_t NumArgs, StringRef Source) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  *Manifest << FnName << '\t' << NumArgs << '\t' << Source.trim() << '\n';
+  Manifest->flush();
+  if (Manifest->has_error())
+    return createFileError(Dir, Manifest->error());
+  return Error::success();
+}
+
+void Library::notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) {
+  StringRef ModuleName = M->getModuleIdentifier();
+  if (!UseObjects || !ModuleName.startswith(FunctionCaller::ModulePrefix))
+    return;
+  StringRef FnName = ModuleName.drop_front(FunctionCaller::ModulePrefix.size());
+  // Written to a temporary file and renamed, so a concurrent start-up never
+  // sees half an object.
+  if (Error Err = writeToOutput(getObjectPath(FnName), [&](raw_ostream &OS) {
+        OS << Obj.getBuffer();
+        return Error::success();
+      }))
+    logAllUnhandledErrors(std::move(Err), errs(), "Could not save object: ");
+}
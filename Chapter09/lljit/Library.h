@@ -0,0 +1,56 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "Caller.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+
+// Keeps the definitions of a session in a directory, so that the next session
+// starts with them instead of recompiling them:
+//
+//   manifest   a line naming the host, the optimization level and whether
+//              fast-math is used, then one "<name>\t<arity>\t<source>"
+//              line per definition
+//   <name>.o   object code of every definition that has been compiled
+//
+// As the JIT's ObjectCache, it saves the object of each definition module the
+// JIT compiles. Objects only fit the host and the options that compiled them;
+// in a library written on another host, or with another optimization level or
+// fast-math setting, the definitions are recompiled from source.
+class Library : public llvm::ObjectCache {
+  std::string Dir;
+  // Manifest as it was when the library was opened.
+  std::unique_ptr<llvm::MemoryBuffer> Contents;
+  bool UseObjects = true;
+  std::mutex Mutex;
+  std::unique_ptr<llvm::raw_fd_ostream> Manifest;
+
+  Library(llvm::StringRef Dir) : Dir(Dir.str()) {}
+  std::string getObjectPath(llvm::StringRef FnName) const;
+
+public:
+  // OptLevel and FastMath are the options definitions are compiled with.
+  static llvm::Expected<std::unique_ptr<Library>>
+  open(llvm::StringRef Dir, unsigned OptLevel, bool FastMath);
+
+  // Defines everything in the manifest, from the saved objects where there
+  // are any. Must be called before Caller records into the library.
+  llvm::Error load(FunctionCaller &Caller);
+
+  // Appends a new definition to the manifest.
+  llvm::Error record(llvm::StringRef FnName, size_t NumArgs,
+                     llvm::StringRef Source);
+
+  void notifyObjectCompiled(const llvm::Module *M,
+                            llvm::MemoryBufferRef Obj) override;
+
+  // Saved objects are added by load() directly, so the compiler never asks.
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *M) override {
+    return nullptr;
+  }
+};
+
+#endif
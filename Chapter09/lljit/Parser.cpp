@@ -9,6 +9,7 @@ AST *Parser::parse() {
 AST *Parser::parseCalc() {
   Expr *E;
   llvm::SmallVector<llvm::StringRef, 8> Vars;
+  llvm::SmallVector<ValueType, 8> Types;
   llvm::StringRef DefFnName;
   if (Tok.is(Token::KW_def)) {
     advance();
@@ -22,12 +23,16 @@ AST *Parser::parseCalc() {
       goto _error;
     Vars.push_back(Tok.getText());
     advance();
+    if (parseType(Types))
+      goto _error;
     while (Tok.is(Token::comma)) {
       advance();
       if (expect(Token::ident))
         goto _error;
       Vars.push_back(Tok.getText());
       advance();
+      if (parseType(Types))
+        goto _error;
     }
     if (consume(Token::r_paren))
       goto _error;
@@ -39,7 +44,7 @@ AST *Parser::parseCalc() {
     if (Vars.empty())
       return E;
     else
-      return new DefDecl(DefFnName, Vars, E);
+      return new DefDecl(DefFnName, Vars, Types, E);
   } else if (Tok.is(Token::ident)) {
     DefFnName = Tok.getText();
     advance();
@@ -68,6 +73,26 @@ _error:
   return nullptr;
 }
 
+// Parses the optional ": type" after a parameter; without it the parameter
+// is an i32.
+bool Parser::parseType(llvm::SmallVectorImpl<ValueType> &Types) {
+  if (!Tok.is(Token::colon)) {
+    Types.push_back(ValueType::I32);
+    return false;
+  }
+  advance();
+  if (expect(Token::ident))
+    return true;
+  std::optional<ValueType> Ty = parseValueType(Tok.getText());
+  if (!Ty) {
+    error();
+    return true;
+  }
+  Types.push_back(*Ty);
+  advance();
+  return false;
+}
+
 Expr *Parser::parseExpr() {
   Expr *Left = parseTerm();
   while (Tok.isOneOf(Token::plus, Token::minus)) {
@@ -33,6 +33,7 @@ class Parser {
   }
 
   AST *parseCalc();
+  bool parseType(llvm::SmallVectorImpl<ValueType> &Types);
   Expr *parseExpr();
   Expr *parseTerm();
   Expr *parseFactor();
@@ -1,13 +1,15 @@
 #include "Sema.h"
-#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace {
 class DeclCheck : public ASTVisitor {
-  llvm::StringSet<> Scope;
+  // Type of each parameter in scope.
+  llvm::StringMap<ValueType> Scope;
   bool HasError;
+  // Type of the expression visited last.
+  ValueType Ty = ValueType::I32;
 
-  StringMap<size_t> &JITtedFunctionsMap;
+  StringMap<FunctionSignature> &JITtedFunctionsMap;
 
   enum ErrorType { Twice, Not };
 
@@ -19,33 +21,48 @@ class DeclCheck : public ASTVisitor {
   }
 
 public:
-  DeclCheck(StringMap<size_t> &JITtedFunctions)
+  DeclCheck(StringMap<FunctionSignature> &JITtedFunctions)
       : JITtedFunctionsMap(JITtedFunctions), HasError(false) {}
 
   bool hasError() { return HasError; }
 
   virtual void visit(Factor &Node) override {
     if (Node.getKind() == Factor::Ident) {
-      if (Scope.find(Node.getVal()) == Scope.end())
+      auto I = Scope.find(Node.getVal());
+      if (I == Scope.end())
         error(Not, Node.getVal());
+      else
+        Ty = I->second;
+    } else if (auto V = CalcValue::parse(Node.getVal())) {
+      Ty = V->Ty;
+    } else {
+      llvm::errs() << "Number " << Node.getVal() << " is out of range\n";
+      HasError = true;
     }
+    Node.setType(Ty);
   };
 
   virtual void visit(BinaryOp &Node) override {
-    if (Node.getLeft())
+    ValueType LeftTy = ValueType::I32;
+    if (Node.getLeft()) {
       Node.getLeft()->accept(*this);
-    else
+      LeftTy = Ty;
+    } else
       HasError = true;
     if (Node.getRight())
       Node.getRight()->accept(*this);
     else
       HasError = true;
+    // Mixed operations are carried out in the wider type.
+    Ty = promote(LeftTy, Ty);
+    Node.setType(Ty);
   };
 
   virtual void visit(DefDecl &Node) override {
+    auto T = Node.getTypes().begin();
     for (auto I = Node.begin(), E = Node.end(); I != E;
-         ++I) {
-      if (!Scope.insert(*I).second)
+         ++I, ++T) {
+      if (!Scope.insert({*I, *T}).second)
         error(Twice, *I);
     }
     if (Node.getExpr())
@@ -62,7 +79,7 @@ public:
     // previously defined.
     auto LookUpFunctionCall = JITtedFunctionsMap.find(FuncCallName);
     if (LookUpFunctionCall != JITtedFunctionsMap.end())
-      NumOriginallyDefinedArgs = LookUpFunctionCall->second;
+      NumOriginallyDefinedArgs = LookUpFunctionCall->second.getNumParams();
     else {
       llvm::errs() << "Specified function definition does not exist!\n";
       HasError = true;
@@ -71,12 +88,27 @@ public:
       llvm::errs() << "Number of parameters specified to the function does not "
                    << "match it's definition!\n";
       HasError = true;
+      return;
+    }
+    unsigned Idx = 0;
+    for (llvm::StringRef Arg : Node.getArgs()) {
+      ValueType ParamTy = LookUpFunctionCall->second.Params[Idx++];
+      auto V = CalcValue::parse(Arg);
+      if (!V) {
+        llvm::errs() << "Number " << Arg << " is out of range\n";
+        HasError = true;
+      } else if (!V->convertTo(ParamTy)) {
+        llvm::errs() << "Argument " << Arg << " does not fit parameter "
+                     << Idx << " of " << FuncCallName << "\n";
+        HasError = true;
+      }
     }
   };
 };
 }
 
-bool Sema::semantic(AST *Tree, StringMap<size_t> &JITtedFunctionsMap) {
+bool Sema::semantic(AST *Tree,
+                    StringMap<FunctionSignature> &JITtedFunctionsMap) {
   if (!Tree)
     return false;
   DeclCheck Check(JITtedFunctionsMap);
@@ -9,7 +9,8 @@ using namespace llvm;
 
 class Sema {
 public:
-  bool semantic(AST *Tree, StringMap<size_t> &JITtedFunctions);
+  // Also sets the type of every expression in Tree.
+  bool semantic(AST *Tree, StringMap<FunctionSignature> &JITtedFunctions);
 };
 
 #endif
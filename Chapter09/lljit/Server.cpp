@@ -0,0 +1,299 @@
+#include "Server.h"
+#include "Parser.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+// Request latencies in power of two nanosecond buckets. Recording is lock
+// free so that it does not serialize the workers.
+class LatencyHistogram {
+  std::array<std::atomic<uint64_t>, 64> Buckets{};
+  std::atomic<uint64_t> Count{0};
+  std::atomic<uint64_t> TotalNs{0};
+  std::atomic<uint64_t> MaxNs{0};
+
+  // Upper bound of the bucket that holds the P-th percentile.
+  uint64_t percentile(uint64_t N, double P) const {
+    uint64_t Rank = std::max<uint64_t>(1, N * P), Seen = 0;
+    for (unsigned I = 0; I != Buckets.size(); ++I) {
+      Seen += Buckets[I].load(std::memory_order_relaxed);
+      if (Seen >= Rank)
+        return std::min(uint64_t(2) << I, MaxNs.load(std::memory_order_relaxed));
+    }
+    return MaxNs.load(std::memory_order_relaxed);
+  }
+
+public:
+  void record(std::chrono::steady_clock::duration D) {
+    uint64_t Ns = std::max<int64_t>(
+        1, std::chrono::duration_cast<std::chrono::nanoseconds>(D).count());
+    Buckets[Log2_64(Ns)].fetch_add(1, std::memory_order_relaxed);
+    Count.fetch_add(1, std::memory_order_relaxed);
+    TotalNs.fetch_add(Ns, std::memory_order_relaxed);
+    uint64_t Max = MaxNs.load(std::memory_order_relaxed);
+    while (Max < Ns &&
+           !MaxNs.compare_exchange_weak(Max, Ns, std::memory_order_relaxed))
+      ;
+  }
+
+  void print(raw_ostream &OS, StringRef Name) const {
+    uint64_t N = Count.load(std::memory_order_relaxed);
+    OS << Name << " n=" << N;
+    if (!N)
+      return;
+    auto Us = [](uint64_t Ns) { return format("%.1f", Ns / 1000.0); };
+    OS << " mean_us=" << Us(TotalNs.load(std::memory_order_relaxed) / N)
+       << " p50_us=" << Us(percentile(N, 0.50))
+       << " p99_us=" << Us(percentile(N, 0.99))
+       << " max_us=" << Us(MaxNs.load(std::memory_order_relaxed));
+  }
+};
+
+class Server {
+  FunctionCaller &Caller;
+  LatencyHistogram DefLatency;
+  LatencyHistogram CallLatency;
+
+  void handleRequest(StringRef Line, raw_ostream &Reply);
+
+public:
+  Server(FunctionCaller &Caller) : Caller(Caller) {}
+  // Answers the complete, newline terminated lines in Requests in order with
+  // a single write to FD. Returns false if the reply could not be sent.
+  bool serveRequests(int FD, std::string &Requests);
+};
+
+// A client connection. Only the event loop touches it, and it is not polled
+// while a worker answers its requests.
+struct Connection {
+  int FD;
+  // Bytes read after the last complete line.
+  std::string Partial;
+  bool Busy = false;
+};
+} // namespace
+
+static Error errnoError(const Twine &What) {
+  return createStringError(std::error_code(errno, std::generic_category()),
+                           What + ": " + sys::StrError());
+}
+
+static bool writeAll(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t N = sys::RetryAfterSignal(-1, ::send, FD, Data.data(), Data.size(),
+                                      MSG_NOSIGNAL);
+    if (N < 0)
+      return false;
+    Data = Data.drop_front(N);
+  }
+  return true;
+}
+
+// Line must be NUL-terminated, as the lexer expects.
+void Server::handleRequest(StringRef Line, raw_ostream &Reply) {
+  StringRef Request = Line.trim();
+  if (Request.empty())
+    return;
+  if (Request == "stats") {
+    DefLatency.print(Reply, "def");
+    Reply << "; ";
+    CallLatency.print(Reply, "call");
+    Reply << "\n";
+    return;
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+  Lexer Lex(Line);
+  if (Lex.peek() == Token::KW_def) {
+    Error Err = Caller.define(Request);
+    DefLatency.record(std::chrono::steady_clock::now() - Start);
+    if (Err)
+      Reply << "error: " << toString(std::move(Err)) << "\n";
+    else
+      Reply << "ok\n";
+    return;
+  }
+
+  bool IsCall = Lex.peek() == Token::ident;
+  Parser Parser(Lex);
+  std::unique_ptr<AST> Tree(Parser.parse());
+  if (!IsCall || !Tree || Parser.hasError()) {
+    Reply << "error: Syntax errors occured\n";
+    return;
+  }
+  auto *Call = static_cast<FuncCallFromDef *>(Tree.get());
+  SmallVector<CalcValue, 8> Args;
+  for (StringRef Arg : Call->getArgs()) {
+    std::optional<CalcValue> Val = CalcValue::parse(Arg);
+    if (!Val) {
+      Reply << "error: Argument " << Arg << " is out of range\n";
+      return;
+    }
+    Args.push_back(*Val);
+  }
+  Expected<CalcValue> Result = Caller.call(Call->getFnName(), Args);
+  CallLatency.record(std::chrono::steady_clock::now() - Start);
+  if (Result)
+    Reply << *Result << "\n";
+  else
+    Reply << "error: " << toString(Result.takeError()) << "\n";
+}
+
+// Replies are collected for every line in a read and sent with a single
+// write, so pipelined requests cost one system call per batch.
+bool Server::serveRequests(int FD, std::string &Requests) {
+  std::string Out;
+  raw_string_ostream Reply(Out);
+  size_t Start = 0;
+  for (size_t NL; (NL = Requests.find('\n', Start)) != std::string::npos;
+       Start = NL + 1) {
+    Requests[NL] = '\0';
+    handleRequest(StringRef(Requests.data() + Start, NL - Start), Reply);
+  }
+  Reply.flush();
+  return writeAll(FD, Out);
+}
+
+Error runServer(FunctionCaller &Caller, StringRef SocketPath,
+                unsigned NumThreads) {
+  sockaddr_un Addr = {};
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path))
+    return createStringError(inconvertibleErrorCode(),
+                             "Socket path is too long: " + SocketPath);
+  std::copy(SocketPath.begin(), SocketPath.end(), Addr.sun_path);
+
+  int ListenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (ListenFD < 0)
+    return errnoError("Could not create socket");
+  // Remove the socket left behind by a previous run.
+  ::unlink(Addr.sun_path);
+  if (::bind(ListenFD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0 ||
+      ::listen(ListenFD, SOMAXCONN) < 0) {
+    Error Err = errnoError("Could not listen on " + SocketPath);
+    ::close(ListenFD);
+    return Err;
+  }
+
+  // Workers report the connections whose requests they answered through a
+  // pipe, which wakes up the poll() below.
+  int WakeFDs[2];
+  if (::pipe(WakeFDs) < 0) {
+    Error Err = errnoError("Could not create pipe");
+    ::close(ListenFD);
+    return Err;
+  }
+  std::mutex DoneMutex;
+  // Connections handed back by the workers, with whether their reply was
+  // sent.
+  std::vector<std::pair<Connection *, bool>> Done;
+
+  Server S(Caller);
+  ThreadPool Workers(hardware_concurrency(NumThreads));
+  errs() << "Listening on " << SocketPath << " with "
+         << Workers.getThreadCount() << " workers\n";
+
+  std::map<int, std::unique_ptr<Connection>> Conns;
+  std::vector<pollfd> PollFDs;
+  auto Close = [&Conns](Connection *C) {
+    ::close(C->FD);
+    Conns.erase(C->FD);
+  };
+
+  Error Err = Error::success();
+  while (true) {
+    PollFDs.clear();
+    PollFDs.push_back({ListenFD, POLLIN, 0});
+    PollFDs.push_back({WakeFDs[0], POLLIN, 0});
+    for (auto &[FD, C] : Conns)
+      if (!C->Busy)
+        PollFDs.push_back({FD, POLLIN, 0});
+    if (sys::RetryAfterSignal(-1, ::poll, PollFDs.data(), PollFDs.size(),
+                              -1) < 0) {
+      Err = errnoError("Could not poll connections");
+      break;
+    }
+
+    if (PollFDs[1].revents) {
+      char Drain[64];
+      (void)::read(WakeFDs[0], Drain, sizeof(Drain));
+      std::lock_guard<std::mutex> Lock(DoneMutex);
+      for (auto [C, Sent] : Done) {
+        C->Busy = false;
+        if (!Sent)
+          Close(C);
+      }
+      Done.clear();
+    }
+
+    for (size_t I = 2; I != PollFDs.size(); ++I) {
+      if (!PollFDs[I].revents)
+        continue;
+      Connection *C = Conns[PollFDs[I].fd].get();
+      char Chunk[4096];
+      ssize_t N = sys::RetryAfterSignal(
+          -1, [&]() { return ::read(C->FD, Chunk, sizeof(Chunk)); });
+      if (N <= 0) {
+        Close(C);
+        continue;
+      }
+      C->Partial.append(Chunk, N);
+      size_t End = C->Partial.rfind('\n');
+      if (End == std::string::npos)
+        continue;
+
+      // Hand the complete lines to a worker. The connection is not read
+      // again until they are answered, which keeps the replies in order.
+      auto Requests = std::make_shared<std::string>(C->Partial, 0, End + 1);
+      C->Partial.erase(0, End + 1);
+      C->Busy = true;
+      Workers.async([&, C, Requests]() {
+        bool Sent = S.serveRequests(C->FD, *Requests);
+        {
+          std::lock_guard<std::mutex> Lock(DoneMutex);
+          Done.push_back({C, Sent});
+        }
+        char Wake = 0;
+        (void)::write(WakeFDs[1], &Wake, 1);
+      });
+    }
+
+    if (PollFDs[0].revents) {
+      int FD = sys::RetryAfterSignal(-1, ::accept, ListenFD, nullptr, nullptr);
+      if (FD < 0) {
+        Err = errnoError("Could not accept connection");
+        break;
+      }
+      Conns[FD] = std::make_unique<Connection>(Connection{FD});
+    }
+  }
+
+  Workers.wait();
+  for (auto &[FD, C] : Conns)
+    ::close(FD);
+  ::close(WakeFDs[0]);
+  ::close(WakeFDs[1]);
+  ::close(ListenFD);
+  ::unlink(Addr.sun_path);
+  return Err;
+}
@@ -0,0 +1,25 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "Caller.h"
+#include "llvm/Support/Error.h"
+
+// Serves calculator requests on a Unix domain socket until accept() fails.
+// Clients send one request per line and get one reply line per non-empty
+// request, in order:
+//
+//   def f(x, y) = x * y   ->  ok
+//   f(3, 4)               ->  12
+//   stats                 ->  latency of the defs and calls served so far
+//
+// A request that fails is answered with "error: <message>". A single thread
+// polls every connection and hands the requests read from one to a pool of
+// NumThreads workers (0 = one per core). A worker is only held while it
+// answers them, so idle connections cost none and calls on different
+// connections are evaluated concurrently against the same JIT. A connection
+// is not read again before its requests are answered, which keeps its replies
+// in order.
+llvm::Error runServer(FunctionCaller &Caller, llvm::StringRef SocketPath,
+                      unsigned NumThreads);
+
+#endif
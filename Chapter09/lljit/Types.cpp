@@ -0,0 +1,100 @@
+#include "Types.h"
+#include "llvm/Support/Format.h"
+#include <limits>
+
+using namespace llvm;
+
+std::optional<ValueType> parseValueType(StringRef Name) {
+  if (Name == "i32")
+    return ValueType::I32;
+  if (Name == "i64")
+    return ValueType::I64;
+  if (Name == "f64")
+    return ValueType::F64;
+  return std::nullopt;
+}
+
+bool FunctionSignature::isAllI32() const {
+  if (Result != ValueType::I32)
+    return false;
+  for (ValueType T : Params)
+    if (T != ValueType::I32)
+      return false;
+  return true;
+}
+
+static char getTypeLetter(ValueType T) {
+  switch (T) {
+  case ValueType::I32:
+    return 'i';
+  case ValueType::I64:
+    return 'l';
+  case ValueType::F64:
+    return 'd';
+  }
+  return '?';
+}
+
+std::string FunctionSignature::getMangledName() const {
+  std::string Name(1, getTypeLetter(Result));
+  Name += '_';
+  for (ValueType T : Params)
+    Name += getTypeLetter(T);
+  return Name;
+}
+
+std::optional<CalcValue> CalcValue::parse(StringRef Literal) {
+  // Besides what the lexer accepts, this reads back what toLiteral() writes,
+  // including exponents, inf and nan.
+  if (Literal.find_first_of(".en") != StringRef::npos) {
+    double D;
+    if (Literal.getAsDouble(D))
+      return std::nullopt;
+    return getF64(D);
+  }
+  int64_t I;
+  if (Literal.getAsInteger(10, I))
+    return std::nullopt;
+  if (I >= std::numeric_limits<int32_t>::min() &&
+      I <= std::numeric_limits<int32_t>::max())
+    return getI32(I);
+  return getI64(I);
+}
+
+std::optional<CalcValue> CalcValue::convertTo(ValueType To) const {
+  if (To == Ty)
+    return *this;
+  if (To < Ty)
+    return std::nullopt;
+  int64_t I = Ty == ValueType::I32 ? V.I32 : V.I64;
+  return To == ValueType::I64 ? getI64(I) : getF64(double(I));
+}
+
+std::string CalcValue::toLiteral() const {
+  std::string S;
+  raw_string_ostream OS(S);
+  if (Ty == ValueType::F64) {
+    // 17 significant digits always read back exactly. Integral values get a
+    // '.' so that they parse as an f64.
+    OS << format("%.17g", V.F64);
+    if (StringRef(S).find_first_of(".en") == StringRef::npos)
+      OS << ".0";
+  } else {
+    print(OS);
+  }
+  return OS.str();
+}
+
+void CalcValue::print(raw_ostream &OS) const {
+  switch (Ty) {
+  case ValueType::I32:
+    OS << V.I32;
+    break;
+  case ValueType::I64:
+    OS << V.I64;
+    break;
+  case ValueType::F64:
+    OS << format("%.15g", V.F64);
+    break;
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Types of calculator values, ordered by width: an operation on two values is
+// carried out in the later of their types.
+enum class ValueType { I32, I64, F64 };
+
+inline ValueType promote(ValueType A, ValueType B) { return A < B ? B : A; }
+
+// Parses "i32", "i64" or "f64".
+std::optional<ValueType> parseValueType(llvm::StringRef Name);
+
+// Parameter and result types of a user defined function.
+struct FunctionSignature {
+  llvm::SmallVector<ValueType, 8> Params;
+  ValueType Result = ValueType::I32;
+
+  size_t getNumParams() const { return Params.size(); }
+
+  // Only functions of i32 get SIMD variants and batch loops.
+  bool isAllI32() const;
+
+  // Spells the types with one letter each, usable in a symbol name: "i_ld"
+  // for an i32 result and (i64, f64) parameters.
+  std::string getMangledName() const;
+};
+
+// Storage of one value. Call trampolines take their arguments and return
+// their result in arrays of these.
+union ValueSlot {
+  int32_t I32;
+  int64_t I64;
+  double F64;
+};
+static_assert(sizeof(ValueSlot) == 8, "trampolines use 8 byte slots");
+
+// A value together with its type.
+struct CalcValue {
+  ValueType Ty = ValueType::I32;
+  ValueSlot V = {0};
+
+  static CalcValue getI32(int32_t X) {
+    CalcValue C;
+    C.V.I32 = X;
+    return C;
+  }
+  static CalcValue getI64(int64_t X) {
+    CalcValue C;
+    C.Ty = ValueType::I64;
+    C.V.I64 = X;
+    return C;
+  }
+  static CalcValue getF64(double X) {
+    CalcValue C;
+    C.Ty = ValueType::F64;
+    C.V.F64 = X;
+    return C;
+  }
+
+  // Parses a number literal. One with a fraction is an f64, any other an i32
+  // if it fits and an i64 otherwise. Nothing if it is not a number or does
+  // not fit at all.
+  static std::optional<CalcValue> parse(llvm::StringRef Literal);
+
+  // Integers widen to wider integers and to f64; nothing converts to a
+  // narrower type.
+  std::optional<CalcValue> convertTo(ValueType To) const;
+
+  // A literal that parse() reads back as exactly this value.
+  std::string toLiteral() const;
+
+  void print(llvm::raw_ostream &OS) const;
+};
+
+inline llvm::raw_ostream &operator<<(llvm::raw_ostream &OS,
+                                     const CalcValue &V) {
+  V.print(OS);
+  return OS;
+}
+
+#endif